@@ -1,3 +1,8 @@
+#ifndef RPE_ABB_CPP
+#define RPE_ABB_CPP
+
+#include "utility.cpp"
+
 // STL dependencies
 #include <algorithm>
 #include <vector>
@@ -6,7 +11,6 @@
 #include <list>
 #include <utility>
 #include <string>
-#include <regex>
 #include <iterator>
 #include <set>
 
@@ -25,6 +29,9 @@
 #include "llvm/Analysis/DDG.h"
 #include "llvm/Analysis/DDGPrinter.h"
 #include "llvm/IR/Constants.h"
+#include "llvm/IR/InlineAsm.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/StringSaver.h"
 
 // JSON dependencies
 #include <jsoncpp/json/json.h>
@@ -36,131 +43,342 @@ using namespace llvm;
 using namespace std;
 
 namespace{
-    enum State
-    {
-        WHITE,
-        GRAY,
-        BLACK
-    };
+    typedef unsigned PROVENANCE_ID; // Index of a node in its function's ProvenanceStore
 
     class ProvenanceNode
     {
     public:
-        string action;
-        string artifact;
-        string id;
-        ProvenanceNode() {}
-        ProvenanceNode(string act, string art, string i)
+        StringRef action;    // Interned by the ProvenanceStore that owns the node
+        StringRef artifact;
+        StringRef id;
+        const Value *object; // Value the id was printed from, or null for the process' own nodes
+        ProvenanceNode() : object(nullptr) {}
+        ProvenanceNode(StringRef act, StringRef art, StringRef i, const Value *obj = nullptr)
         {
             action = act;
             artifact = art;
             id = i;
+            object = obj;
         }
     };
 
-    class AugmentedBasicBlock
+    /**
+     * Owns the provenance nodes of one function. Nodes sit in one contiguous array and are
+     * referred to by index. Their strings are interned in a bump allocator, so a node is a
+     * few words, and the whole store is released at once with the function's analysis.
+     */
+    class ProvenanceStore
     {
     private:
-        string blockId;                     // Unique Block Id
-        bool isRootBlock;                   // Defines if this is the starting block of the function.
-        bool isConditionalBlock;            // Does it have branching at the end or just a straight jump to next block
-        bool hasInlineAssembly;             // Is there any inline assembly instruction? Then parse separately
-        string trueBlock;                   // If branched, then next true block
-        string falseBlock;                  // If branched, then next false block
-        string nextBlock;                   // If not branched, then next block
-        vector<Instruction *> instructions; // All the call instructions are stored here (operation and arguments)
-        vector<StringRef> functions;        // All the functions are stored here (Name only)
-        vector<string> parents;             // Can keep track of the parent blocks if implementation wants
+        BumpPtrAllocator allocator;
+        UniqueStringSaver strings;
+        vector<ProvenanceNode> nodes;
+
     public:
-        AugmentedBasicBlock()
+        ProvenanceStore() : strings(allocator) {}
+        ProvenanceStore(const ProvenanceStore &) = delete;
+        ProvenanceStore &operator=(const ProvenanceStore &) = delete;
+
+        StringRef intern(StringRef text)
         {
-            isConditionalBlock = false;
-            hasInlineAssembly = false;
-            isRootBlock = false;
+            return strings.save(text);
         }
-
-        string getBlockId()
+        PROVENANCE_ID addNode(StringRef action, StringRef artifact, StringRef id, const Value *object = nullptr)
+        {
+            nodes.push_back(ProvenanceNode(intern(action), intern(artifact), intern(id), object));
+            return nodes.size() - 1;
+        }
+        ProvenanceNode &getNode(PROVENANCE_ID node)
         {
-            return blockId;
+            return nodes[node];
         }
-        void setBlockId(string blockID)
+        const ProvenanceNode &getNode(PROVENANCE_ID node) const
         {
-            blockId = blockID;
+            return nodes[node];
         }
+        unsigned size() const
+        {
+            return nodes.size();
+        }
+        // Drops the nodes but keeps the interned strings for the next ones.
+        void clearNodes()
+        {
+            nodes.clear();
+        }
+    };
+
+    // How control reaches a successor, from the terminator of the block. Same order as ModelSuccessorKind.
+    enum SuccessorKind
+    {
+        NextSuccessor,     // Unconditional branch
+        TrueSuccessor,     // Conditional branch taken
+        FalseSuccessor,    // Conditional branch not taken
+        CaseSuccessor,     // A case of a switch, or a handler of a catchswitch
+        DefaultSuccessor,  // Default of a switch, or the fallthrough of a callbr
+        NormalSuccessor,   // Normal return of an invoke
+        UnwindSuccessor,   // Exception edge
+        IndirectSuccessor, // Target of an indirectbr, or an indirect target of a callbr
+        NUM_SUCCESSOR_KINDS
+    };
 
-        void setRootBlock()
+    struct BlockSuccessor
+    {
+        BLOCK_ID block;
+        SuccessorKind kind;
+    };
+
+    // Kind of the index-th successor of terminator, as numbered by Instruction::getSuccessor.
+    static SuccessorKind getSuccessorKind(const Instruction *terminator, unsigned index)
+    {
+        if (const BranchInst *branch = dyn_cast<BranchInst>(terminator))
         {
-            isRootBlock = true;
+            if (branch->isUnconditional())
+            {
+                return NextSuccessor;
+            }
+            return index == 0 ? TrueSuccessor : FalseSuccessor;
         }
-        bool isARootBlock()
+        if (isa<SwitchInst>(terminator))
         {
-            return isRootBlock;
+            return index == 0 ? DefaultSuccessor : CaseSuccessor;
         }
-        void setInlineAssembly()
+        if (isa<InvokeInst>(terminator))
         {
-            hasInlineAssembly = true;
+            return index == 0 ? NormalSuccessor : UnwindSuccessor;
         }
-        bool getInlineAssemblyStatus()
+        if (isa<CallBrInst>(terminator))
         {
-            return hasInlineAssembly;
+            return index == 0 ? DefaultSuccessor : IndirectSuccessor;
         }
-        void setConditionalBlock()
+        if (isa<IndirectBrInst>(terminator))
         {
-            isConditionalBlock = true;
+            return IndirectSuccessor;
         }
-        bool getConditionalBlock()
+        if (const CatchSwitchInst *catchSwitch = dyn_cast<CatchSwitchInst>(terminator))
         {
-            return isConditionalBlock;
+            bool isUnwind = catchSwitch->hasUnwindDest() && terminator->getSuccessor(index) == catchSwitch->getUnwindDest();
+            return isUnwind ? UnwindSuccessor : CaseSuccessor;
         }
-        string getNextBlock()
+        if (isa<CleanupReturnInst>(terminator))
+        {
+            return UnwindSuccessor;
+        }
+        return NextSuccessor; // catchret
+    }
+
+    enum InlineAsmOperandKind
+    {
+        AsmOutput, // '=': written by the assembly
+        AsmInput,  // Read by the assembly
+        AsmClobber // '~': a register or memory the assembly overwrites
+    };
+
+    /**
+     * One comma separated entry of the constraint string of an inline assembly call.
+     * Direct outputs are results of the call, in order. Inputs and indirect outputs ('*',
+     * the address of the output) consume the arguments of the call, in order.
+     */
+    struct InlineAsmOperand
+    {
+        StringRef constraint; // The entry, into the constraint string of the InlineAsm
+        InlineAsmOperandKind kind;
+        bool isIndirect;
+        bool isEarlyClobber;  // '&': written before every input is read
+        const Value *value;   // The call for direct outputs, the argument otherwise, null for clobbers
+        unsigned index;       // Of the result among the outputs, or of the argument
+    };
+
+    struct InlineAssembly
+    {
+        const CallBase *call;
+        StringRef asmString;  // Owned by the InlineAsm, which lives as long as the context
+        StringRef constraints;
+        bool hasSideEffects;
+        uint32_t firstOperand;
+        uint32_t numOperands;
+    };
+
+    enum AugmentedBlockFlags
+    {
+        RootBlock = 1,          // The starting block of the function
+        ConditionalBlock = 2,   // The terminator has more than one successor
+        InlineAssemblyBlock = 4 // Calls inline assembly, which is parsed separately
+    };
+
+    /**
+     * Summary of one basic block, 40 bytes with no pointers of its own. Its successors, its
+     * call instructions, the names of the functions they call and its inline assembly are
+     * ranges into arrays that AugmentedCFG shares between all blocks of the function, and its
+     * label and predecessors are those of the same block id in CompactCFG.
+     */
+    struct AugmentedBasicBlock
+    {
+        BLOCK_ID blockId;
+        uint32_t flags; // AugmentedBlockFlags
+        uint32_t firstSuccessor;
+        uint32_t numSuccessors;
+        uint32_t firstInstruction;
+        uint32_t numInstructions;
+        uint32_t firstFunction;
+        uint32_t numFunctions;
+        uint32_t firstAssembly;
+        uint32_t numAssemblies;
+
+        bool isARootBlock() const
         {
-            return nextBlock;
+            return flags & RootBlock;
         }
-        void setNextBlock(string nextB)
+        bool getConditionalBlock() const
         {
-            nextBlock = nextB;
+            return flags & ConditionalBlock;
         }
-        string getTrueBlock()
+        bool getInlineAssemblyStatus() const
         {
-            return trueBlock;
+            return flags & InlineAssemblyBlock;
         }
-        void setTrueBlock(string trueB)
+    };
+    static_assert(sizeof(AugmentedBasicBlock) == 40, "AugmentedBasicBlock has padding");
+
+    /**
+     * The augmented blocks of one function, indexed like its CompactCFG. Blocks are added in
+     * the order of their ids, and everything added after a block belongs to it, so each
+     * per-block array stays one contiguous allocation. Accessors return views into those
+     * arrays, so visiting a block on a path copies nothing.
+     */
+    class AugmentedCFG
+    {
+    private:
+        vector<AugmentedBasicBlock> blocks;
+        vector<BlockSuccessor> successors;  // Every successor of each terminator, in its order
+        vector<Instruction *> instructions; // All the call instructions (operation and arguments)
+        vector<StringRef> functions;        // Names of the functions called directly
+        vector<InlineAssembly> assemblies;
+        vector<InlineAsmOperand> asmOperands;
+
+        template <typename T>
+        static ArrayRef<T> slice(const vector<T> &items, uint32_t first, uint32_t count)
         {
-            trueBlock = trueB;
+            return ArrayRef<T>(items.data() + first, count);
         }
-        string getFalseBlock()
+
+    public:
+        void clear()
         {
-            return falseBlock;
+            blocks.clear();
+            successors.clear();
+            instructions.clear();
+            functions.clear();
+            assemblies.clear();
+            asmOperands.clear();
         }
-        void setFalseBlock(string falseB)
+        void reserve(unsigned numBlocks)
         {
-            falseBlock = falseB;
+            blocks.reserve(numBlocks);
+            successors.reserve(numBlocks * 2);
         }
 
-        vector<Instruction *> getInstructions()
+        void addBlock(BLOCK_ID blockId)
         {
-            return instructions;
+            AugmentedBasicBlock block = {blockId, 0, (uint32_t)successors.size(), 0, (uint32_t)instructions.size(), 0,
+                                         (uint32_t)functions.size(), 0, (uint32_t)assemblies.size(), 0};
+            blocks.push_back(block);
         }
-        void addInstruction(Instruction *instruction)
+        void setFlag(AugmentedBlockFlags flag)
         {
-            instructions.push_back(instruction);
+            blocks.back().flags |= flag;
         }
-        vector<StringRef> getFunctions()
+        void addSuccessor(BLOCK_ID block, SuccessorKind kind)
         {
-            return functions;
+            successors.push_back(BlockSuccessor{block, kind});
+            blocks.back().numSuccessors++;
+        }
+        void addInstruction(Instruction *instruction)
+        {
+            instructions.push_back(instruction);
+            blocks.back().numInstructions++;
         }
         void addFunction(StringRef functionName)
         {
             functions.push_back(functionName);
+            blocks.back().numFunctions++;
+        }
+        // Reads the operands of a call to inline assembly from its constraints.
+        void addInlineAssembly(const CallBase *call)
+        {
+            const InlineAsm *assembly = cast<InlineAsm>(call->getCalledOperand());
+            StringRef constraintString = assembly->getConstraintString();
+            InlineAssembly record = {call, assembly->getAsmString(), constraintString, assembly->hasSideEffects(), (uint32_t)asmOperands.size(), 0};
+
+            SmallVector<StringRef, 8> entries;
+            if (!constraintString.empty())
+            {
+                constraintString.split(entries, ',');
+            }
+            InlineAsm::ConstraintInfoVector constraints = assembly->ParseConstraints();
+            // ParseConstraints gives up on malformed strings. Such calls keep no operands.
+            if (constraints.size() == entries.size())
+            {
+                unsigned numResults = 0;
+                unsigned numArguments = 0;
+                for (unsigned i = 0; i < constraints.size(); i++)
+                {
+                    const InlineAsm::ConstraintInfo &constraint = constraints[i];
+                    InlineAsmOperand operand = {entries[i], AsmInput, constraint.isIndirect, constraint.isEarlyClobber, nullptr, 0};
+                    if (constraint.Type == InlineAsm::isClobber)
+                    {
+                        operand.kind = AsmClobber;
+                    }
+                    else if (constraint.Type == InlineAsm::isOutput && !constraint.isIndirect)
+                    {
+                        operand.kind = AsmOutput;
+                        operand.value = call;
+                        operand.index = numResults++;
+                    }
+                    else if (numArguments < call->arg_size())
+                    {
+                        operand.kind = constraint.Type == InlineAsm::isOutput ? AsmOutput : AsmInput;
+                        operand.value = call->getArgOperand(numArguments);
+                        operand.index = numArguments++;
+                    }
+                    asmOperands.push_back(operand);
+                    record.numOperands++;
+                }
+            }
+            assemblies.push_back(record);
+            blocks.back().numAssemblies++;
+            blocks.back().flags |= InlineAssemblyBlock;
+        }
+
+        unsigned size() const
+        {
+            return blocks.size();
+        }
+        const AugmentedBasicBlock &operator[](BLOCK_ID block) const
+        {
+            return blocks[block];
+        }
+        ArrayRef<BlockSuccessor> getSuccessors(BLOCK_ID block) const
+        {
+            return slice(successors, blocks[block].firstSuccessor, blocks[block].numSuccessors);
+        }
+        ArrayRef<Instruction *> getInstructions(BLOCK_ID block) const
+        {
+            return slice(instructions, blocks[block].firstInstruction, blocks[block].numInstructions);
+        }
+        ArrayRef<StringRef> getFunctions(BLOCK_ID block) const
+        {
+            return slice(functions, blocks[block].firstFunction, blocks[block].numFunctions);
         }
-        vector<string> getParents()
+        ArrayRef<InlineAssembly> getInlineAssembly(BLOCK_ID block) const
         {
-            return parents;
+            return slice(assemblies, blocks[block].firstAssembly, blocks[block].numAssemblies);
         }
-        void addParent(string parent)
+        ArrayRef<InlineAsmOperand> getOperands(const InlineAssembly &assembly) const
         {
-            parents.push_back(parent);
+            return slice(asmOperands, assembly.firstOperand, assembly.numOperands);
         }
     };
 
-}
\ No newline at end of file
+}
+
+#endif
@@ -0,0 +1,419 @@
+// Times the phases of the path engine on synthetic functions of controlled shape, and the heap
+// high-water mark of each phase above what was live when it started.
+// Usage: rpe-benchmark [-repetitions N] [-shape prefix] [-rpe-path-threshold N]
+
+#include "pass.cpp"
+
+// LLVM dependencies
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/Format.h"
+
+#include <chrono>
+#include <malloc.h>
+#include <new>
+
+using namespace llvm;
+using namespace std;
+
+static cl::opt<unsigned> Repetitions(
+    "repetitions",
+    cl::desc("Times each shape is analyzed from scratch. The median time and the largest peak are reported"),
+    cl::init(5));
+
+static cl::opt<string> ShapeFilter(
+    "shape",
+    cl::desc("Only run the shapes whose name starts with this"),
+    cl::init(""));
+
+// Heap accounting. Every allocation of the process goes through the operators below, which
+// count the usable size of each block. The benchmark runs on one thread.
+static size_t liveHeapBytes = 0;
+static size_t peakHeapBytes = 0;
+
+static void *allocateCounted(size_t size) noexcept
+{
+    void *block = malloc(size == 0 ? 1 : size);
+    if (block != nullptr)
+    {
+        liveHeapBytes += malloc_usable_size(block);
+        peakHeapBytes = max(peakHeapBytes, liveHeapBytes);
+    }
+    return block;
+}
+
+static void freeCounted(void *block) noexcept
+{
+    if (block != nullptr)
+    {
+        liveHeapBytes -= malloc_usable_size(block);
+        free(block);
+    }
+}
+
+void *operator new(size_t size)
+{
+    void *block = allocateCounted(size);
+    if (block == nullptr)
+    {
+        report_bad_alloc_error("Out of memory");
+    }
+    return block;
+}
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+void *operator new(size_t size, const nothrow_t &) noexcept
+{
+    return allocateCounted(size);
+}
+void *operator new[](size_t size, const nothrow_t &) noexcept
+{
+    return allocateCounted(size);
+}
+void operator delete(void *block) noexcept
+{
+    freeCounted(block);
+}
+void operator delete[](void *block) noexcept
+{
+    freeCounted(block);
+}
+void operator delete(void *block, size_t) noexcept
+{
+    freeCounted(block);
+}
+void operator delete[](void *block, size_t) noexcept
+{
+    freeCounted(block);
+}
+void operator delete(void *block, const nothrow_t &) noexcept
+{
+    freeCounted(block);
+}
+void operator delete[](void *block, const nothrow_t &) noexcept
+{
+    freeCounted(block);
+}
+
+namespace
+{
+    /**
+     * Emits the blocks of one synthetic function. Conditions and switch operands come from
+     * calls to an external source() and every arm calls an external sink(), so the CFG is
+     * kept as built and every block has a call for its ABB.
+     */
+    class ShapeBuilder
+    {
+    private:
+        Function *function;
+        IRBuilder<> builder;
+        FunctionCallee source;
+        FunctionCallee sink;
+        unsigned numBlocks;
+
+    public:
+        ShapeBuilder(Module &M, StringRef name) : builder(M.getContext())
+        {
+            LLVMContext &context = M.getContext();
+            Type *int32 = Type::getInt32Ty(context);
+            source = M.getOrInsertFunction("source", int32);
+            sink = M.getOrInsertFunction("sink", Type::getVoidTy(context), int32);
+            function = Function::Create(FunctionType::get(Type::getVoidTy(context), false), Function::ExternalLinkage, name, M);
+            numBlocks = 0;
+            builder.SetInsertPoint(addBlock());
+        }
+
+        BasicBlock *addBlock()
+        {
+            return BasicBlock::Create(function->getContext(), "b" + to_string(numBlocks++), function);
+        }
+        Value *getInput()
+        {
+            return builder.CreateCall(source);
+        }
+        Value *getCondition()
+        {
+            return builder.CreateICmpNE(getInput(), builder.getInt32(0));
+        }
+        void addSink(Value *value)
+        {
+            builder.CreateCall(sink, value);
+        }
+        void addSink(unsigned tag)
+        {
+            addSink(builder.getInt32(tag));
+        }
+
+        // n if/else diamonds in a row, 2^n acyclic paths.
+        void addDiamonds(unsigned n)
+        {
+            for (unsigned i = 0; i < n; i++)
+            {
+                BasicBlock *thenBlock = addBlock();
+                BasicBlock *elseBlock = addBlock();
+                BasicBlock *joinBlock = addBlock();
+                builder.CreateCondBr(getCondition(), thenBlock, elseBlock);
+                builder.SetInsertPoint(thenBlock);
+                addSink(2 * i);
+                builder.CreateBr(joinBlock);
+                builder.SetInsertPoint(elseBlock);
+                addSink(2 * i + 1);
+                builder.CreateBr(joinBlock);
+                builder.SetInsertPoint(joinBlock);
+            }
+        }
+
+        // A counted loop per level, nested depth deep, with diamonds in the innermost body.
+        // Counters live in allocas, so the DDG sees a store/load cycle per loop.
+        void addNestedLoops(unsigned depth, unsigned diamonds)
+        {
+            if (depth == 0)
+            {
+                addDiamonds(diamonds);
+                return;
+            }
+            Value *counter = builder.CreateAlloca(builder.getInt32Ty());
+            builder.CreateStore(builder.getInt32(0), counter);
+            BasicBlock *header = addBlock();
+            BasicBlock *body = addBlock();
+            BasicBlock *exit = addBlock();
+            builder.CreateBr(header);
+
+            builder.SetInsertPoint(header);
+            Value *value = builder.CreateLoad(builder.getInt32Ty(), counter);
+            builder.CreateCondBr(builder.CreateICmpSLT(value, builder.getInt32(10)), body, exit);
+
+            builder.SetInsertPoint(body);
+            addNestedLoops(depth - 1, diamonds);
+            Value *next = builder.CreateAdd(builder.CreateLoad(builder.getInt32Ty(), counter), builder.getInt32(1));
+            builder.CreateStore(next, counter);
+            builder.CreateBr(header);
+
+            builder.SetInsertPoint(exit);
+        }
+
+        // count switches in a row, each with width cases and a default, (width + 1)^count paths.
+        void addSwitchFans(unsigned width, unsigned count)
+        {
+            for (unsigned i = 0; i < count; i++)
+            {
+                BasicBlock *joinBlock = addBlock();
+                SwitchInst *fan = builder.CreateSwitch(getInput(), joinBlock, width);
+                for (unsigned c = 0; c < width; c++)
+                {
+                    BasicBlock *caseBlock = addBlock();
+                    fan->addCase(builder.getInt32(c), caseBlock);
+                    builder.SetInsertPoint(caseBlock);
+                    addSink(c);
+                    builder.CreateBr(joinBlock);
+                }
+                builder.SetInsertPoint(joinBlock);
+            }
+        }
+
+        // One block that moves a value through a few slots, length loads and stores long.
+        void addStoreLoadChain(unsigned length)
+        {
+            static const unsigned NUM_SLOTS = 8;
+            vector<Value *> slots;
+            for (unsigned i = 0; i < NUM_SLOTS; i++)
+            {
+                slots.push_back(builder.CreateAlloca(builder.getInt32Ty()));
+            }
+            builder.CreateStore(getInput(), slots[0]);
+            for (unsigned i = 0; i < length; i++)
+            {
+                Value *value = builder.CreateLoad(builder.getInt32Ty(), slots[i % NUM_SLOTS]);
+                builder.CreateStore(value, slots[(i + 1) % NUM_SLOTS]);
+                if (i % 64 == 0)
+                {
+                    addSink(value);
+                }
+            }
+        }
+
+        Function *finish()
+        {
+            builder.CreateRetVoid();
+            return function;
+        }
+    };
+
+    struct Shape
+    {
+        const char *name;
+        function<void(ShapeBuilder &)> build;
+    };
+
+    static const char *const PHASE_NAMES[] = {
+        "cfg + loops", "abb", "ddg", "path counts", "looping paths", "canonical paths", "expandPath", "alias classes"};
+    static const unsigned NUM_PHASES = sizeof(PHASE_NAMES) / sizeof(PHASE_NAMES[0]);
+
+    // Records the ids of the canonical paths, so expansion can be timed on its own.
+    class PathIdSink : public PathSink
+    {
+    public:
+        vector<PATH_ID> ids;
+        PATH_COUNT expandedPaths = 0;
+
+        void consumeCanonicalPath(PATH_ID id, const PATH &path) override
+        {
+            ids.push_back(id);
+        }
+        void consumeExpandedPath(const PATH &path) override
+        {
+            expandedPaths++;
+        }
+    };
+
+    struct PhaseResult
+    {
+        vector<double> milliseconds;
+        size_t peakBytes = 0;
+    };
+
+    // Runs one phase and adds its time and heap high-water mark to result.
+    template <typename PHASE>
+    static void measure(PhaseResult &result, PHASE phase)
+    {
+        size_t baseline = liveHeapBytes;
+        peakHeapBytes = liveHeapBytes;
+        auto start = chrono::steady_clock::now();
+        phase();
+        auto end = chrono::steady_clock::now();
+        result.milliseconds.push_back(chrono::duration<double, milli>(end - start).count());
+        result.peakBytes = max(result.peakBytes, peakHeapBytes - baseline);
+    }
+
+    static void runShape(const Shape &shape, raw_ostream &out)
+    {
+        LLVMContext context;
+        Module M("benchmark", context);
+        ShapeBuilder builder(M, shape.name);
+        shape.build(builder);
+        Function &function = *builder.finish();
+
+        PhaseResult results[NUM_PHASES];
+        PATH_COUNT canonicalPaths = 0;
+        PATH_COUNT expandedPaths = 0;
+        unsigned aliased = 0;
+        for (unsigned repetition = 0; repetition < Repetitions; repetition++)
+        {
+            FunctionAnalysis analysis(function);
+            unique_ptr<PathIdSink> sink(new PathIdSink());
+            measure(results[0], [&]()
+                    {
+                        DominatorTree domTree(function);
+                        LoopInfo loopInfo(domTree);
+                        prepareFunction(analysis, function, loopInfo, domTree); });
+            measure(results[1], [&]()
+                    { buildAugmentedBlocks(analysis); });
+            measure(results[2], [&]()
+                    { buildValueDependences(analysis); });
+            measure(results[3], [&]()
+                    {
+                        analysis.dagAdjList = extractDirectedAdjList(analysis.cfg.getSuccessorGraph(), analysis.loops);
+                        countFunctionPaths(analysis, analysis.cfg, analysis.dagAdjList); });
+            measure(results[4], [&]()
+                    { extractLoopingPaths(analysis, analysis.dagAdjList, analysis.cfg); });
+
+            // The traversal hands every canonical path to expandPath as well, so the expansion
+            // is timed again on its own below.
+            // Reserved up front, so the ids are not charged to the traversal.
+            sink->ids.reserve(min<PATH_COUNT>(analysis.canonicalPathCount, PathEnumerationThreshold));
+            analysis.pathSink = sink.get();
+            measure(results[5], [&]()
+                    {
+                        sink->beginFunction(function, analysis.cfg);
+                        extractCanonicalPaths(analysis);
+                        sink->endFunction(); });
+            canonicalPaths = sink->ids.size();
+            sink->expandedPaths = 0;
+            measure(results[6], [&]()
+                    {
+                        PATH path;
+                        for (PATH_ID id : sink->ids)
+                        {
+                            analysis.canonicalNumbering.regeneratePath(id, path);
+                            generatePathsFromCanonicalPath(analysis, path);
+                        } });
+            expandedPaths = sink->expandedPaths;
+
+            measure(results[7], [&]()
+                    {
+                        analysis.loadStoreAliases.clear();
+                        analysis.loadStoreAliases.build(analysis.ddg, isLoadStoreEdge);
+                        // Every pair among at most 256 values spread over the function.
+                        unsigned numValues = analysis.ddg.getNumValues();
+                        unsigned step = max(1u, numValues / 256);
+                        aliased = 0;
+                        for (VALUE_ID source = 0; source < numValues; source += step)
+                        {
+                            for (VALUE_ID target = 0; target < numValues; target += step)
+                            {
+                                aliased += analysis.loadStoreAliases.getClass(source) == analysis.loadStoreAliases.getClass(target);
+                            }
+                        }
+                    });
+            analysis.pathSink = nullptr;
+        }
+
+        unsigned numInstructions = function.getInstructionCount();
+        out << shape.name << ": " << function.size() << " blocks, " << numInstructions << " instructions, "
+            << canonicalPaths << " canonical and " << expandedPaths << " expanded paths, " << aliased << " aliased pairs\n";
+        for (unsigned phase = 0; phase < NUM_PHASES; phase++)
+        {
+            vector<double> &times = results[phase].milliseconds;
+            llvm::sort(times);
+            out << format("  %-16s %10.3f ms %10.1f KiB\n", PHASE_NAMES[phase], times[times.size() / 2], results[phase].peakBytes / 1024.0);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    cl::ParseCommandLineOptions(argc, argv, "Times the phases of the path engine on synthetic functions\n");
+    if (Repetitions == 0)
+    {
+        errs() << "ERROR: -repetitions must be at least 1\n";
+        return 1;
+    }
+
+    const Shape shapes[] = {
+        {"diamonds-8", [](ShapeBuilder &b)
+         { b.addDiamonds(8); }},
+        {"diamonds-16", [](ShapeBuilder &b)
+         { b.addDiamonds(16); }},
+        {"loops-2x2", [](ShapeBuilder &b)
+         { b.addNestedLoops(2, 2); }},
+        {"loops-4x3", [](ShapeBuilder &b)
+         { b.addNestedLoops(4, 3); }},
+        {"switch-16x2", [](ShapeBuilder &b)
+         { b.addSwitchFans(16, 2); }},
+        {"switch-64x2", [](ShapeBuilder &b)
+         { b.addSwitchFans(64, 2); }},
+        {"chain-1000", [](ShapeBuilder &b)
+         { b.addStoreLoadChain(1000); }},
+        {"chain-20000", [](ShapeBuilder &b)
+         { b.addStoreLoadChain(20000); }},
+        {"mixed", [](ShapeBuilder &b)
+         {
+             b.addStoreLoadChain(500);
+             b.addNestedLoops(2, 2);
+             b.addSwitchFans(8, 2);
+             b.addDiamonds(4);
+         }},
+    };
+    for (const Shape &shape : shapes)
+    {
+        if (StringRef(shape.name).startswith(ShapeFilter))
+        {
+            runShape(shape, outs());
+        }
+    }
+    return 0;
+}
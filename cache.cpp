@@ -0,0 +1,240 @@
+#ifndef RPE_CACHE_CPP
+#define RPE_CACHE_CPP
+
+#include "utility.cpp"
+#include "encoder.cpp"
+
+// LLVM dependencies
+#include "llvm/IR/InlineAsm.h"
+#include "llvm/IR/ModuleSlotTracker.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/EndianStream.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+
+using namespace llvm;
+using namespace std;
+
+static const uint32_t CACHE_MAGIC = 0x43455052; // "RPEC"
+static const uint32_t CACHE_VERSION = 1;
+
+typedef MD5::MD5Result CACHE_KEY;
+
+namespace
+{
+    /**
+     * Key of a function in AnalysisCache: an MD5 hash of everything the analysis reads from
+     * the function, and of the options its output depends on. Values are hashed the way the
+     * analysis prints them, so a change that cannot change the output, such as renumbered
+     * metadata or an edit to another function, keeps the key.
+     */
+    static CACHE_KEY getFunctionCacheKey(const Function &function, StringRef options)
+    {
+        MD5 hash;
+        auto addString = [&hash](StringRef text)
+        {
+            uint8_t size[8];
+            support::endian::write64le(size, text.size());
+            hash.update(ArrayRef<uint8_t>(size, 8));
+            hash.update(text);
+        };
+        addString(options);
+        addString(function.getName());
+
+        ModuleSlotTracker slots(function.getParent(), false);
+        slots.incorporateFunction(function);
+        string text;
+        raw_string_ostream out(text);
+        for (const BasicBlock &block : function)
+        {
+            addString(getSimpleNodeLabel(block, slots));
+            for (const Instruction &inst : block)
+            {
+                text.clear();
+                out << inst.getOpcodeName() << " ";
+                inst.getType()->print(out);
+                if (!inst.getType()->isVoidTy())
+                {
+                    out << " ";
+                    inst.printAsOperand(out, false, slots);
+                }
+                if (const CmpInst *cmp = dyn_cast<CmpInst>(&inst))
+                {
+                    out << " " << CmpInst::getPredicateName(cmp->getPredicate());
+                }
+                if (const AllocaInst *alloca = dyn_cast<AllocaInst>(&inst))
+                {
+                    out << " ";
+                    alloca->getAllocatedType()->print(out);
+                }
+                for (const Use &operand : inst.operands())
+                {
+                    if (isa<MetadataAsValue>(operand.get()))
+                    {
+                        continue;
+                    }
+                    out << ", ";
+                    if (const InlineAsm *assembly = dyn_cast<InlineAsm>(operand.get()))
+                    {
+                        out << assembly->getAsmString() << " " << assembly->getConstraintString();
+                    }
+                    else
+                    {
+                        operand->printAsOperand(out, true, slots);
+                    }
+                }
+                addString(out.str());
+            }
+        }
+        CACHE_KEY key;
+        hash.final(key);
+        return key;
+    }
+
+    /**
+     * What the pass produced for one function: its log, its records of -rpe-path-sink=file
+     * and its tables in the model file.
+     */
+    struct CachedAnalysis
+    {
+        string log;
+        string paths;
+        ModelEncoder model;
+    };
+
+    /**
+     * Results of unchanged functions, kept across runs in a directory with one file per
+     * function, named after its key:
+     *   CACHE_MAGIC, CACHE_VERSION, the key, then the name of the function as a ModelString,
+     *   and the log, the paths and every model table, each as a 64 bit length and its bytes.
+     * Numbers are little endian and tables are kept as ModelEncoder holds them. Entries are
+     * written to a temporary file and renamed into place, so concurrent builds sharing a
+     * directory only ever see whole entries.
+     */
+    class AnalysisCache
+    {
+    private:
+        string directory;
+
+        string getEntryName(const CACHE_KEY &key) const
+        {
+            SmallString<128> path(directory);
+            sys::path::append(path, key.digest().str() + ".rpec");
+            return path.str().str();
+        }
+
+        static bool readBlob(StringRef &contents, StringRef &blob)
+        {
+            if (contents.size() < 8)
+            {
+                return false;
+            }
+            uint64_t size = support::endian::read64le(contents.data());
+            contents = contents.drop_front(8);
+            if (size > contents.size())
+            {
+                return false;
+            }
+            blob = contents.take_front(size);
+            contents = contents.drop_front(size);
+            return true;
+        }
+
+        static void writeBlob(raw_ostream &out, StringRef blob)
+        {
+            support::endian::write<uint64_t>(out, blob.size(), support::little);
+            out << blob;
+        }
+
+    public:
+        bool open(StringRef cacheDirectory, string &error)
+        {
+            directory = cacheDirectory.str();
+            error_code ec = sys::fs::create_directories(directory);
+            if (ec)
+            {
+                error = ec.message();
+                return false;
+            }
+            return true;
+        }
+
+        // Fails when the function has no entry, or its entry is unreadable.
+        bool load(const CACHE_KEY &key, CachedAnalysis &result) const
+        {
+            ErrorOr<unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(getEntryName(key), false, false);
+            if (!buffer)
+            {
+                return false;
+            }
+            StringRef contents = (*buffer)->getBuffer();
+            if (contents.size() < 8 + sizeof(key) + 8 || support::endian::read32le(contents.data()) != CACHE_MAGIC ||
+                support::endian::read32le(contents.data() + 4) != CACHE_VERSION ||
+                memcmp(contents.data() + 8, key.Bytes.data(), sizeof(key)) != 0)
+            {
+                return false;
+            }
+            contents = contents.drop_front(8 + sizeof(key));
+            ModelString name;
+            name.offset = support::endian::read32le(contents.data());
+            name.size = support::endian::read32le(contents.data() + 4);
+            contents = contents.drop_front(8);
+
+            StringRef log;
+            StringRef paths;
+            StringRef tables[NUM_MODEL_TABLES];
+            if (!readBlob(contents, log) || !readBlob(contents, paths))
+            {
+                return false;
+            }
+            for (StringRef &table : tables)
+            {
+                if (!readBlob(contents, table))
+                {
+                    return false;
+                }
+            }
+            if (!contents.empty() || !result.model.loadTables(name, tables))
+            {
+                return false;
+            }
+            result.log = log.str();
+            result.paths = paths.str();
+            return true;
+        }
+
+        // A failed store only costs the next run a miss, so it is not reported.
+        void store(const CACHE_KEY &key, StringRef log, StringRef paths, const ModelEncoder &model) const
+        {
+            string entryName = getEntryName(key);
+            int fd = -1;
+            SmallString<128> temporaryName;
+            if (sys::fs::createUniqueFile(entryName + ".%%%%%%%%", fd, temporaryName))
+            {
+                return;
+            }
+            raw_fd_ostream out(fd, true);
+            support::endian::write<uint32_t>(out, CACHE_MAGIC, support::little);
+            support::endian::write<uint32_t>(out, CACHE_VERSION, support::little);
+            out.write((const char *)key.Bytes.data(), sizeof(key));
+            support::endian::write<uint32_t>(out, model.getName().offset, support::little);
+            support::endian::write<uint32_t>(out, model.getName().size, support::little);
+            writeBlob(out, log);
+            writeBlob(out, paths);
+            for (unsigned table = 0; table < NUM_MODEL_TABLES; table++)
+            {
+                writeBlob(out, model.getTable((ModelTable)table));
+            }
+            out.close();
+            if (out.has_error() || sys::fs::rename(temporaryName, entryName))
+            {
+                out.clear_error();
+                sys::fs::remove(temporaryName);
+            }
+        }
+    };
+}
+
+#endif
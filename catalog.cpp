@@ -0,0 +1,210 @@
+#ifndef RPE_CATALOG_CPP
+#define RPE_CATALOG_CPP
+
+#include "utility.cpp"
+
+// LLVM dependencies
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/StringSaver.h"
+
+using namespace llvm;
+using namespace std;
+
+// Object of a relevant function that is the value it returns rather than one of its arguments.
+static const int RETURNED_OBJECT = -1;
+
+// The catalog used without -rpe-catalog. Files fed to -rpe-catalog follow the same format.
+static const char *const DEFAULT_CATALOG = R"({
+    "functions": [
+        {"names": ["open", "fopen"], "artifact": "FILE", "object": "return"},
+        {"names": ["read", "write", "close", "fclose"], "artifact": "FILE", "object": 0},
+        {"names": ["fread", "fwrite"], "artifact": "FILE", "object": 3}
+    ]
+})";
+
+namespace
+{
+    /**
+     * How a call to a relevant function shows up in the provenance of a path: as an action
+     * named after the function, on an artifact of some kind, whose object is an argument of
+     * the call or the value it returns.
+     */
+    struct RelevantFunctionSpec
+    {
+        StringRef action;
+        StringRef artifact;
+        int object; // Index of the argument, or RETURNED_OBJECT
+    };
+
+    /**
+     * The relevant functions, by name, read from a JSON spec:
+     *   {"functions": [{"name": "open", "artifact": "FILE", "object": "return"},
+     *                  {"names": ["read", "write"], "artifact": "FILE", "object": 0}, ...]}
+     * "object" is either the index of the argument the function acts on, or "return" for the
+     * value it returns. A name listed twice keeps its last entry.
+     */
+    class RelevantFunctionCatalog
+    {
+    private:
+        BumpPtrAllocator allocator;
+        UniqueStringSaver strings;
+        StringMap<RelevantFunctionSpec> specs;
+        string digest;
+
+        bool addEntry(const Json::Value &entry, string &error)
+        {
+            const Json::Value &artifact = entry["artifact"];
+            const Json::Value &object = entry["object"];
+            if (!artifact.isString())
+            {
+                error = "entry without an artifact";
+                return false;
+            }
+            int objectIndex = RETURNED_OBJECT;
+            if (object.isIntegral() && object.asInt() >= 0)
+            {
+                objectIndex = object.asInt();
+            }
+            else if (!object.isString() || object.asString() != "return")
+            {
+                error = "object of " + artifact.asString() + " entry is neither an argument index nor \"return\"";
+                return false;
+            }
+
+            vector<string> names;
+            if (entry["name"].isString())
+            {
+                names.push_back(entry["name"].asString());
+            }
+            for (const Json::Value &name : entry["names"])
+            {
+                if (!name.isString())
+                {
+                    error = "function name is not a string";
+                    return false;
+                }
+                names.push_back(name.asString());
+            }
+            if (names.empty())
+            {
+                error = "entry without a name";
+                return false;
+            }
+            StringRef savedArtifact = strings.save(artifact.asString());
+            for (const string &name : names)
+            {
+                auto inserted = specs.insert(make_pair(name, RelevantFunctionSpec()));
+                RelevantFunctionSpec &spec = inserted.first->getValue();
+                spec.action = inserted.first->getKey();
+                spec.artifact = savedArtifact;
+                spec.object = objectIndex;
+            }
+            return true;
+        }
+
+    public:
+        RelevantFunctionCatalog() : strings(allocator) {}
+        RelevantFunctionCatalog(const RelevantFunctionCatalog &) = delete;
+        RelevantFunctionCatalog &operator=(const RelevantFunctionCatalog &) = delete;
+
+        bool parse(StringRef contents, string &error)
+        {
+            specs.clear();
+            Json::CharReaderBuilder builder;
+            unique_ptr<Json::CharReader> reader(builder.newCharReader());
+            Json::Value root;
+            if (!reader->parse(contents.begin(), contents.end(), &root, &error))
+            {
+                return false;
+            }
+            if (!root.isObject() || !root["functions"].isArray())
+            {
+                error = "no \"functions\" array";
+                return false;
+            }
+            for (const Json::Value &entry : root["functions"])
+            {
+                if (!entry.isObject() || !addEntry(entry, error))
+                {
+                    if (error.empty())
+                    {
+                        error = "entry is not an object";
+                    }
+                    specs.clear();
+                    return false;
+                }
+            }
+            MD5 hash;
+            hash.update(contents);
+            MD5::MD5Result result;
+            hash.final(result);
+            digest = result.digest().str().str();
+            return true;
+        }
+
+        bool load(StringRef fileName, string &error)
+        {
+            ErrorOr<unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(fileName);
+            if (!buffer)
+            {
+                error = buffer.getError().message();
+                return false;
+            }
+            return parse((*buffer)->getBuffer(), error);
+        }
+
+        const RelevantFunctionSpec *find(StringRef name) const
+        {
+            auto found = specs.find(name);
+            return found == specs.end() ? nullptr : &found->getValue();
+        }
+
+        unsigned size() const
+        {
+            return specs.size();
+        }
+
+        // Hash of the spec the catalog was parsed from, for the keys of the cache.
+        const string &getDigest() const
+        {
+            return digest;
+        }
+    };
+
+    /**
+     * The catalog resolved against the functions of one module, so a call site is classified
+     * with one lookup of its callee instead of a lookup of its name. Only read once resolved,
+     * so it can be shared by every thread.
+     */
+    class RelevantFunctions
+    {
+    private:
+        DenseMap<const Function *, const RelevantFunctionSpec *> specs;
+
+    public:
+        void resolve(const Module &M, const RelevantFunctionCatalog &catalog)
+        {
+            specs.clear();
+            for (const Function &function : M)
+            {
+                if (const RelevantFunctionSpec *spec = catalog.find(function.getName()))
+                {
+                    specs[&function] = spec;
+                }
+            }
+        }
+
+        // Null for callees that are not relevant, including unknown ones.
+        const RelevantFunctionSpec *find(const Function *callee) const
+        {
+            auto found = specs.find(callee);
+            return found == specs.end() ? nullptr : found->second;
+        }
+    };
+}
+
+#endif
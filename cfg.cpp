@@ -0,0 +1,270 @@
+#ifndef RPE_CFG_CPP
+#define RPE_CFG_CPP
+
+#include "utility.cpp"
+
+// LLVM dependencies
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Analysis/CFGPrinter.h"
+#include "llvm/Support/GraphWriter.h"
+#include "llvm/Support/Path.h"
+
+using namespace llvm;
+using namespace std;
+
+namespace
+{
+    /**
+     * Adjacency structure in compressed sparse row form.
+     * The children of node n are targets[offsets[n] .. offsets[n + 1]).
+     * Nodes are appended with addNode() and every addEdge() call extends the last appended node.
+     */
+    class CSRGraph
+    {
+    private:
+        vector<unsigned> offsets;
+        vector<BLOCK_ID> targets;
+
+    public:
+        CSRGraph()
+        {
+            offsets.push_back(0);
+        }
+
+        void clear()
+        {
+            offsets.assign(1, 0);
+            targets.clear();
+        }
+        void reserve(unsigned numNodes, unsigned numEdges)
+        {
+            offsets.reserve(numNodes + 1);
+            targets.reserve(numEdges);
+        }
+        void addNode()
+        {
+            offsets.push_back(targets.size());
+        }
+        void addEdge(BLOCK_ID child)
+        {
+            targets.push_back(child);
+            offsets.back()++;
+        }
+
+        unsigned getNumNodes() const
+        {
+            return offsets.size() - 1;
+        }
+        unsigned getNumEdges() const
+        {
+            return targets.size();
+        }
+        // Position of the node's first child among all edges, for data kept per edge.
+        unsigned getFirstEdge(BLOCK_ID node) const
+        {
+            return offsets[node];
+        }
+        ArrayRef<BLOCK_ID> getChildren(BLOCK_ID node) const
+        {
+            return ArrayRef<BLOCK_ID>(targets.data() + offsets[node], targets.data() + offsets[node + 1]);
+        }
+    };
+
+    /**
+     * Integer indexed control flow graph of a single function.
+     * Blocks are numbered densely in layout order, so the entry block is always 0.
+     * Successors keep the terminator's operand order (true block before false block).
+     * Labels are only produced on request and cached, since printAsOperand numbers the whole function.
+     */
+    class CompactCFG
+    {
+    private:
+        vector<const BasicBlock *> blocks;
+        DenseMap<const BasicBlock *, BLOCK_ID> blockIds;
+        CSRGraph successorGraph;
+        CSRGraph predecessorGraph;
+        mutable vector<string> labels;
+
+    public:
+        void build(const Function &function)
+        {
+            blocks.clear();
+            blockIds.clear();
+            successorGraph.clear();
+            predecessorGraph.clear();
+            labels.clear();
+
+            for (const BasicBlock &basicBlock : function)
+            {
+                blockIds[&basicBlock] = blocks.size();
+                blocks.push_back(&basicBlock);
+            }
+
+            vector<unsigned> inDegree(blocks.size(), 0);
+            successorGraph.reserve(blocks.size(), blocks.size() * 2);
+            for (const BasicBlock *basicBlock : blocks)
+            {
+                successorGraph.addNode();
+                for (const BasicBlock *successor : successors(basicBlock))
+                {
+                    BLOCK_ID child = blockIds[successor];
+                    successorGraph.addEdge(child);
+                    inDegree[child]++;
+                }
+            }
+
+            // Predecessors are derived from the successor lists rather than the use lists,
+            // which keeps their order independent of how the IR was constructed.
+            vector<vector<BLOCK_ID>> parents(blocks.size());
+            for (BLOCK_ID node = 0; node < blocks.size(); node++)
+            {
+                parents[node].reserve(inDegree[node]);
+            }
+            for (BLOCK_ID node = 0; node < blocks.size(); node++)
+            {
+                for (BLOCK_ID child : successorGraph.getChildren(node))
+                {
+                    parents[child].push_back(node);
+                }
+            }
+            predecessorGraph.reserve(blocks.size(), successorGraph.getNumEdges());
+            for (BLOCK_ID node = 0; node < blocks.size(); node++)
+            {
+                predecessorGraph.addNode();
+                for (BLOCK_ID parent : parents[node])
+                {
+                    predecessorGraph.addEdge(parent);
+                }
+            }
+        }
+
+        unsigned size() const
+        {
+            return blocks.size();
+        }
+        BLOCK_ID getRoot() const
+        {
+            return 0;
+        }
+        const CSRGraph &getSuccessorGraph() const
+        {
+            return successorGraph;
+        }
+        ArrayRef<BLOCK_ID> getSuccessors(BLOCK_ID node) const
+        {
+            return successorGraph.getChildren(node);
+        }
+        ArrayRef<BLOCK_ID> getPredecessors(BLOCK_ID node) const
+        {
+            return predecessorGraph.getChildren(node);
+        }
+        const BasicBlock *getBlock(BLOCK_ID node) const
+        {
+            return blocks[node];
+        }
+        BLOCK_ID getId(const BasicBlock *basicBlock) const
+        {
+            return blockIds.lookup(basicBlock);
+        }
+
+        const string &getLabel(BLOCK_ID node) const
+        {
+            static const string loopStart = "LOOP_START";
+            static const string loopEnd = "LOOP_END";
+            if (node == LOOP_START_MARKER)
+            {
+                return loopStart;
+            }
+            if (node == LOOP_END_MARKER)
+            {
+                return loopEnd;
+            }
+            if (labels.empty())
+            {
+                // All at once, numbering the function a single time.
+                const Function *function = blocks[0]->getParent();
+                ModuleSlotTracker slots(function->getParent(), false);
+                slots.incorporateFunction(*function);
+                labels.reserve(blocks.size());
+                for (const BasicBlock *block : blocks)
+                {
+                    labels.push_back(getSimpleNodeLabel(*block, slots));
+                }
+            }
+            return labels[node];
+        }
+    };
+
+    static void printEdgeList(raw_ostream &out, const CompactCFG &cfg)
+    {
+        for (BLOCK_ID node = 0; node < cfg.size(); node++)
+        {
+            for (BLOCK_ID child : cfg.getSuccessors(node))
+            {
+                out << cfg.getLabel(node) << " -> " << cfg.getLabel(child) << "\n";
+            }
+        }
+    }
+
+    static void printLoopingBlocks(raw_ostream &out, const vector<BLOCK_ID> &loopingBlocks, const CompactCFG &cfg)
+    {
+        out << "Looping blocks are: ";
+        for (BLOCK_ID elem : loopingBlocks)
+        {
+            out << cfg.getLabel(elem) << " ";
+        }
+        out << "\n";
+    }
+
+    static void printAdjacencyList(raw_ostream &out, const CSRGraph &graph, const CompactCFG &cfg)
+    {
+        out << "Adjacency List Is:\n";
+        for (BLOCK_ID node = 0; node < graph.getNumNodes(); node++)
+        {
+            out << cfg.getLabel(node) << " -> ";
+            for (BLOCK_ID elem : graph.getChildren(node))
+            {
+                out << cfg.getLabel(elem) << ", ";
+            }
+            out << "\n";
+        }
+    }
+
+    static void printPath(raw_ostream &out, const PATH &p, const CompactCFG &cfg)
+    {
+        out << "START -> ";
+        for (BLOCK_ID node : p)
+        {
+            out << cfg.getLabel(node) << " ->";
+        }
+        out << " END\n";
+    }
+
+    static void printBackEdges(raw_ostream &out, ArrayRef<EDGE> backEdges, const CompactCFG &cfg)
+    {
+        for (EDGE edge : backEdges)
+        {
+            out << cfg.getLabel(edge.first) << " : " << cfg.getLabel(edge.first) << " -> " << cfg.getLabel(edge.second) << "\n";
+        }
+    }
+
+    // Writes the CFG of a function to <directory>/cfg.<function>.dot, as -dot-cfg does. Only reads the IR.
+    static void writeDotFile(const Function &function, StringRef directory)
+    {
+        SmallString<128> fileName(directory);
+        sys::path::append(fileName, "cfg." + function.getName() + ".dot");
+        error_code ec;
+        raw_fd_ostream output(fileName, ec, sys::fs::OF_Text);
+        if (ec)
+        {
+            errs() << "ERROR: Could not write " << fileName << ": " << ec.message() << "\n";
+            return;
+        }
+        DOTFuncInfo cfgInfo(&function);
+        WriteGraph(output, &cfgInfo);
+    }
+}
+
+#endif
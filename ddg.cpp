@@ -0,0 +1,389 @@
+#ifndef RPE_DDG_CPP
+#define RPE_DDG_CPP
+
+#include "cfg.cpp"
+
+// LLVM dependencies
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/STLFunctionalExtras.h"
+#include "llvm/IR/ModuleSlotTracker.h"
+
+#include <memory>
+
+using namespace llvm;
+using namespace std;
+
+typedef unsigned VALUE_ID; // Dense index of a value inside its function's ValueTable
+typedef unsigned TYPE_ID;  // Dense index of a type inside its function's ValueTable
+
+namespace
+{
+    /**
+     * Interns the values and types seen by one function as small integers.
+     * Their printed form is only produced on request and cached. All values share one
+     * slot tracker, so the function is numbered once instead of on every print.
+     */
+    class ValueTable
+    {
+    private:
+        const Function *function;
+        mutable unique_ptr<ModuleSlotTracker> slotTracker;
+        DenseMap<const Value *, VALUE_ID> valueIds;
+        vector<const Value *> values;
+        vector<TYPE_ID> valueTypes;
+        mutable vector<string> valueNames;
+        DenseMap<Type *, TYPE_ID> typeIds;
+        vector<Type *> types;
+        mutable vector<string> typeNames;
+
+    public:
+        ValueTable()
+        {
+            function = nullptr;
+        }
+
+        void reset(const Function &currentFunction)
+        {
+            function = &currentFunction;
+            slotTracker.reset();
+            valueIds.clear();
+            values.clear();
+            valueTypes.clear();
+            valueNames.clear();
+            typeIds.clear();
+            types.clear();
+            typeNames.clear();
+        }
+
+        TYPE_ID getTypeId(Type *type)
+        {
+            auto inserted = typeIds.insert(make_pair(type, (TYPE_ID)types.size()));
+            if (inserted.second)
+            {
+                types.push_back(type);
+                typeNames.emplace_back();
+            }
+            return inserted.first->second;
+        }
+
+        // Interns value, and records recordedType as its type. The last recorded type wins.
+        VALUE_ID getValueId(const Value *value, Type *recordedType)
+        {
+            auto inserted = valueIds.insert(make_pair(value, (VALUE_ID)values.size()));
+            if (inserted.second)
+            {
+                values.push_back(value);
+                valueTypes.push_back(0);
+                valueNames.emplace_back();
+            }
+            VALUE_ID id = inserted.first->second;
+            valueTypes[id] = getTypeId(recordedType);
+            return id;
+        }
+        VALUE_ID getValueId(const Value *value)
+        {
+            return getValueId(value, value->getType());
+        }
+
+        // Id of a value that was already interned. Fails for values the table has not seen.
+        bool findValueId(const Value *value, VALUE_ID &id) const
+        {
+            auto found = valueIds.find(value);
+            if (found == valueIds.end())
+            {
+                return false;
+            }
+            id = found->second;
+            return true;
+        }
+
+        unsigned size() const
+        {
+            return values.size();
+        }
+        const Value *getValue(VALUE_ID id) const
+        {
+            return values[id];
+        }
+        TYPE_ID getType(VALUE_ID id) const
+        {
+            return valueTypes[id];
+        }
+
+        // Values that print as <badref>: void results, which get no slot, and values that are
+        // not part of a function.
+        bool isDetached(VALUE_ID id) const
+        {
+            const Value *value = values[id];
+            if (value->getType()->isVoidTy())
+            {
+                return true;
+            }
+            if (const Instruction *inst = dyn_cast<Instruction>(value))
+            {
+                return inst->getParent() == nullptr || inst->getParent()->getParent() == nullptr;
+            }
+            if (const Argument *argument = dyn_cast<Argument>(value))
+            {
+                return argument->getParent() == nullptr;
+            }
+            if (const BasicBlock *basicBlock = dyn_cast<BasicBlock>(value))
+            {
+                return basicBlock->getParent() == nullptr;
+            }
+            return false;
+        }
+
+        // Same text as getStringRepresentationOfValue. Void results are named without a lookup,
+        // as a failed one makes LLVM number the whole function again.
+        const string &getName(VALUE_ID id) const
+        {
+            if (valueNames[id].empty() && values[id]->getType()->isVoidTy())
+            {
+                valueNames[id] = "<badref>";
+            }
+            else if (valueNames[id].empty())
+            {
+                if (!slotTracker)
+                {
+                    slotTracker.reset(new ModuleSlotTracker(function->getParent(), false));
+                    slotTracker->incorporateFunction(*function);
+                }
+                raw_string_ostream OS(valueNames[id]);
+                values[id]->printAsOperand(OS, false, *slotTracker);
+                OS.flush();
+            }
+            return valueNames[id];
+        }
+
+        // Same text as getTypeFromAddress.
+        const string &getTypeName(TYPE_ID id) const
+        {
+            if (typeNames[id].empty())
+            {
+                typeNames[id] = getTypeFromAddress(types[id]);
+            }
+            return typeNames[id];
+        }
+    };
+
+    enum DDGLabel
+    {
+        StoreEdge,
+        LoadEdge,
+        CallEdge,          // detail is the VALUE_ID of the called operand
+        GetElementPtrEdge,
+        TruncateEdge,
+        ICmpEdge,          // detail is the operand index in bit 16 and the predicate below it
+        OpcodeEdge         // detail is the opcode of the instruction
+    };
+
+    struct ValueDependence
+    {
+        VALUE_ID target;
+        DDGLabel label;
+        unsigned detail;
+    };
+
+    /**
+     * Data dependence graph of one function, over interned values.
+     * Edges are kept per source value in insertion order.
+     */
+    class ValueDependenceGraph
+    {
+    private:
+        ValueTable values;
+        vector<vector<ValueDependence>> successors; // Indexed by the VALUE_ID of the source
+        unsigned numEdges;
+
+    public:
+        ValueDependenceGraph()
+        {
+            numEdges = 0;
+        }
+
+        void reset(const Function &function)
+        {
+            values.reset(function);
+            successors.clear();
+            numEdges = 0;
+        }
+
+        ValueTable &getValues()
+        {
+            return values;
+        }
+        const ValueTable &getValues() const
+        {
+            return values;
+        }
+        VALUE_ID addValue(const Value *value, Type *recordedType)
+        {
+            return values.getValueId(value, recordedType);
+        }
+        VALUE_ID addValue(const Value *value)
+        {
+            return values.getValueId(value);
+        }
+
+        void addEdge(VALUE_ID source, VALUE_ID target, DDGLabel label, unsigned detail = 0)
+        {
+            if (successors.size() <= source)
+            {
+                successors.resize(source + 1);
+            }
+            ValueDependence edge = {target, label, detail};
+            successors[source].push_back(edge);
+            numEdges++;
+        }
+
+        unsigned getNumValues() const
+        {
+            return values.size();
+        }
+        unsigned getNumEdges() const
+        {
+            return numEdges;
+        }
+        ArrayRef<ValueDependence> getEdges(VALUE_ID source) const
+        {
+            if (source >= successors.size())
+            {
+                return ArrayRef<ValueDependence>();
+            }
+            return successors[source];
+        }
+
+        // The label in the form the string based graph used, e.g. "call:open" or "icmp:1 slt".
+        string getLabelString(const ValueDependence &edge) const
+        {
+            switch (edge.label)
+            {
+            case StoreEdge:
+                return "store";
+            case LoadEdge:
+                return "load";
+            case CallEdge:
+            {
+                const Value *callee = values.getValue(edge.detail);
+                if (callee->hasName())
+                {
+                    return "call:" + callee->getName().str();
+                }
+                return "call:" + values.getName(edge.detail);
+            }
+            case GetElementPtrEdge:
+                return "getelementptr";
+            case TruncateEdge:
+                return "truncate";
+            case ICmpEdge:
+            {
+                CmpInst::Predicate predicate = (CmpInst::Predicate)(edge.detail & 0xffff);
+                return "icmp:" + to_string(edge.detail >> 16) + " " + CmpInst::getPredicateName(predicate).str();
+            }
+            case OpcodeEdge:
+                return Instruction::getOpcodeName(edge.detail);
+            }
+            return "";
+        }
+    };
+
+    /**
+     * Partitions the values of a DDG into the classes connected by a subgraph of its edges,
+     * ignoring edge direction. Edges to values that are not objects (see isObjectValue) are
+     * left out, so a constant stored into two slots does not join them. Built once with
+     * union-find; classes are flattened afterwards so getClass is a single lookup. The classes
+     * are a snapshot: edges added to the graph afterwards are not seen until the next build.
+     */
+    class AliasClasses
+    {
+    private:
+        bool built;
+        vector<unsigned> parents; // Indexed by VALUE_ID. After build() every entry is its class.
+        vector<unsigned> sizes;
+
+        unsigned findRoot(unsigned node)
+        {
+            while (parents[node] != node)
+            {
+                parents[node] = parents[parents[node]]; // Path halving
+                node = parents[node];
+            }
+            return node;
+        }
+
+        void unite(unsigned first, unsigned second)
+        {
+            first = findRoot(first);
+            second = findRoot(second);
+            if (first == second)
+            {
+                return;
+            }
+            if (sizes[first] < sizes[second])
+            {
+                swap(first, second);
+            }
+            parents[second] = first;
+            sizes[first] += sizes[second];
+        }
+
+    public:
+        AliasClasses()
+        {
+            built = false;
+        }
+
+        bool isBuilt() const
+        {
+            return built;
+        }
+        void clear()
+        {
+            built = false;
+            parents.clear();
+            sizes.clear();
+        }
+
+        void build(const ValueDependenceGraph &ddg, function_ref<bool(const ValueDependence &)> inSubgraph)
+        {
+            unsigned numValues = ddg.getNumValues();
+            parents.resize(numValues);
+            sizes.assign(numValues, 1);
+            for (VALUE_ID value = 0; value < numValues; value++)
+            {
+                parents[value] = value;
+            }
+            const ValueTable &values = ddg.getValues();
+            for (VALUE_ID value = 0; value < numValues; value++)
+            {
+                if (!isObjectValue(values.getValue(value)))
+                {
+                    continue;
+                }
+                for (const ValueDependence &edge : ddg.getEdges(value))
+                {
+                    if (inSubgraph(edge) && isObjectValue(values.getValue(edge.target)))
+                    {
+                        unite(value, edge.target);
+                    }
+                }
+            }
+            for (VALUE_ID value = 0; value < numValues; value++)
+            {
+                parents[value] = findRoot(value);
+            }
+            sizes.clear();
+            built = true;
+        }
+
+        // Representative of the class of value. Values added after build() are their own class.
+        unsigned getClass(VALUE_ID value) const
+        {
+            return value < parents.size() ? parents[value] : value;
+        }
+    };
+}
+
+#endif
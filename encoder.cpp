@@ -0,0 +1,369 @@
+#ifndef RPE_ENCODER_CPP
+#define RPE_ENCODER_CPP
+
+#include "model.cpp"
+
+// LLVM dependencies
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+
+using namespace llvm;
+using namespace std;
+
+namespace
+{
+    /**
+     * Builds the tables of one function, in the layout described in model.cpp. Records are
+     * appended to their table as they come, so tables can be filled in any order, and strings
+     * are interned in the function's own string table. Offsets are only assigned once
+     * ModelFileWriter places the tables in the file, so every function can be encoded on its
+     * own thread.
+     */
+    class ModelEncoder
+    {
+    private:
+        StringMap<ModelString> stringIds;
+        string strings;
+        ModelString name;
+
+        vector<ModelBlockRecord> blocks;
+        vector<ModelString> callees;
+        vector<ModelSuccessorRecord> successors;
+        vector<uint32_t> blockIds;
+        vector<ModelLoopRecord> loops;
+        vector<ModelPathsRecord> paths;
+        vector<uint64_t> pathIds;
+        vector<ModelValueRecord> values;
+        vector<ModelDependenceRecord> dependences;
+        vector<ModelChainRecord> chains;
+        vector<ModelProvenanceRecord> provenance;
+
+        template <typename T>
+        static StringRef getBytes(const vector<T> &table)
+        {
+            return StringRef((const char *)table.data(), table.size() * sizeof(T));
+        }
+
+        template <typename T>
+        static void setBytes(vector<T> &table, StringRef bytes)
+        {
+            table.resize(bytes.size() / sizeof(T));
+            if (!bytes.empty())
+            {
+                memcpy(table.data(), bytes.data(), bytes.size());
+            }
+        }
+
+        ModelRange addBlockIds(ArrayRef<unsigned> ids)
+        {
+            ModelRange range = {(uint32_t)blockIds.size(), (uint32_t)ids.size()};
+            blockIds.insert(blockIds.end(), ids.begin(), ids.end());
+            return range;
+        }
+
+    public:
+        ModelEncoder()
+        {
+            name = ModelString{0, 0};
+        }
+        ModelEncoder(const ModelEncoder &) = delete;
+        ModelEncoder &operator=(const ModelEncoder &) = delete;
+
+        ModelString getString(StringRef text)
+        {
+            auto inserted = stringIds.insert(make_pair(text, ModelString{(uint32_t)strings.size(), (uint32_t)text.size()}));
+            if (inserted.second)
+            {
+                strings.append(text.data(), text.size());
+            }
+            return inserted.first->getValue();
+        }
+
+        void setName(StringRef functionName)
+        {
+            name = getString(functionName);
+        }
+        ModelString getName() const
+        {
+            return name;
+        }
+        StringRef getNameString() const
+        {
+            return StringRef(strings.data() + name.offset, name.size);
+        }
+
+        // Blocks are added in the order of their ids.
+        void addBlock(StringRef label, uint32_t flags, ArrayRef<StringRef> blockCallees, ArrayRef<ModelSuccessorRecord> blockSuccessors, ArrayRef<unsigned> children)
+        {
+            ModelBlockRecord block;
+            block.label = getString(label);
+            block.flags = flags;
+            block.callees = ModelRange{(uint32_t)callees.size(), (uint32_t)blockCallees.size()};
+            for (StringRef callee : blockCallees)
+            {
+                callees.push_back(getString(callee));
+            }
+            block.successors = ModelRange{(uint32_t)successors.size(), (uint32_t)blockSuccessors.size()};
+            successors.insert(successors.end(), blockSuccessors.begin(), blockSuccessors.end());
+            block.children = addBlockIds(children);
+            blocks.push_back(block);
+        }
+
+        // Loops are added parents first, so parent is the index of a loop added before.
+        void addLoop(unsigned header, unsigned parent, ArrayRef<unsigned> latches)
+        {
+            ModelLoopRecord loop;
+            loop.header = header;
+            loop.parent = parent;
+            loop.latches = addBlockIds(latches);
+            loops.push_back(loop);
+        }
+
+        void addPaths(ModelPathKind kind, unsigned source, unsigned target, uint64_t numPaths, vector<uint64_t> ids, uint32_t budgets = 0)
+        {
+            llvm::sort(ids);
+            ModelPathsRecord numbering;
+            numbering.kind = kind;
+            numbering.source = source;
+            numbering.target = target;
+            numbering.budgets = budgets;
+            numbering.numPaths = numPaths;
+            numbering.firstId = pathIds.size();
+            numbering.numIds = ids.size();
+            pathIds.insert(pathIds.end(), ids.begin(), ids.end());
+            paths.push_back(numbering);
+        }
+
+        // Values are added in the order of their ids, each followed by its edges.
+        void addValue(StringRef valueName, StringRef typeName)
+        {
+            ModelValueRecord value;
+            value.name = getString(valueName);
+            value.type = getString(typeName);
+            value.edges = ModelRange{(uint32_t)dependences.size(), 0};
+            values.push_back(value);
+        }
+        void addDependence(unsigned target, StringRef label)
+        {
+            dependences.push_back(ModelDependenceRecord{target, getString(label)});
+            values.back().edges.count++;
+        }
+
+        // Every chain is followed by its nodes.
+        void addChain(uint64_t pathId)
+        {
+            chains.push_back(ModelChainRecord{pathId, ModelRange{(uint32_t)provenance.size(), 0}});
+        }
+        void addProvenanceNode(StringRef action, StringRef artifact, StringRef id)
+        {
+            provenance.push_back(ModelProvenanceRecord{getString(action), getString(artifact), getString(id)});
+            chains.back().nodes.count++;
+        }
+
+        // Contents of a table, as they go into the file.
+        StringRef getTable(ModelTable table) const
+        {
+            switch (table)
+            {
+            case MODEL_BLOCKS:
+                return getBytes(blocks);
+            case MODEL_CALLEES:
+                return getBytes(callees);
+            case MODEL_SUCCESSORS:
+                return getBytes(successors);
+            case MODEL_BLOCK_IDS:
+                return getBytes(blockIds);
+            case MODEL_LOOPS:
+                return getBytes(loops);
+            case MODEL_PATHS:
+                return getBytes(paths);
+            case MODEL_PATH_IDS:
+                return getBytes(pathIds);
+            case MODEL_VALUES:
+                return getBytes(values);
+            case MODEL_DEPENDENCES:
+                return getBytes(dependences);
+            case MODEL_CHAINS:
+                return getBytes(chains);
+            case MODEL_PROVENANCE:
+                return getBytes(provenance);
+            default:
+                return StringRef(strings);
+            }
+        }
+
+        // Replaces the tables with ones getTable() returned before, as kept by AnalysisCache.
+        // Every index in the tables is relative to the function, so they can be moved as they are.
+        bool loadTables(ModelString functionName, const StringRef tables[NUM_MODEL_TABLES])
+        {
+            for (unsigned table = 0; table < NUM_MODEL_TABLES; table++)
+            {
+                if (tables[table].size() % MODEL_ENTRY_SIZES[table] != 0)
+                {
+                    return false;
+                }
+            }
+            if (functionName.offset > tables[MODEL_STRINGS].size() || functionName.size > tables[MODEL_STRINGS].size() - functionName.offset)
+            {
+                return false;
+            }
+            clear();
+            setBytes(blocks, tables[MODEL_BLOCKS]);
+            setBytes(callees, tables[MODEL_CALLEES]);
+            setBytes(successors, tables[MODEL_SUCCESSORS]);
+            setBytes(blockIds, tables[MODEL_BLOCK_IDS]);
+            setBytes(loops, tables[MODEL_LOOPS]);
+            setBytes(paths, tables[MODEL_PATHS]);
+            setBytes(pathIds, tables[MODEL_PATH_IDS]);
+            setBytes(values, tables[MODEL_VALUES]);
+            setBytes(dependences, tables[MODEL_DEPENDENCES]);
+            setBytes(chains, tables[MODEL_CHAINS]);
+            setBytes(provenance, tables[MODEL_PROVENANCE]);
+            strings = tables[MODEL_STRINGS].str();
+            name = functionName;
+            return true;
+        }
+
+        // Leaves the encoder empty for the next function.
+        void clear()
+        {
+            stringIds.clear();
+            strings.clear();
+            name = ModelString{0, 0};
+            blocks.clear();
+            callees.clear();
+            successors.clear();
+            blockIds.clear();
+            loops.clear();
+            paths.clear();
+            pathIds.clear();
+            values.clear();
+            dependences.clear();
+            chains.clear();
+            provenance.clear();
+        }
+    };
+
+    /**
+     * Writes the model file of one module. Functions are appended in the order they are
+     * added, the index is sorted by name and written by close(), and the header is written
+     * last over the placeholder open() left, so a file that was not closed is rejected
+     * by readers.
+     */
+    class ModelFileWriter
+    {
+    private:
+        unique_ptr<raw_fd_ostream> out;
+        uint64_t position;
+        vector<ModelFunctionRecord> index;
+        vector<string> names; // Of the records of index
+
+        void write(StringRef bytes)
+        {
+            out->write(bytes.data(), bytes.size());
+            position += bytes.size();
+        }
+
+        void align()
+        {
+            static const char zeros[MODEL_ALIGNMENT] = {};
+            uint64_t padding = (MODEL_ALIGNMENT - position % MODEL_ALIGNMENT) % MODEL_ALIGNMENT;
+            write(StringRef(zeros, padding));
+        }
+
+    public:
+        ModelFileWriter()
+        {
+            position = 0;
+        }
+        ModelFileWriter(const ModelFileWriter &) = delete;
+        ModelFileWriter &operator=(const ModelFileWriter &) = delete;
+
+        bool open(StringRef fileName, string &error)
+        {
+            if (sys::IsBigEndianHost)
+            {
+                error = "model files are little endian and can only be written on a little endian host";
+                return false;
+            }
+            error_code ec;
+            out.reset(new raw_fd_ostream(fileName, ec));
+            if (ec)
+            {
+                error = ec.message();
+                out.reset();
+                return false;
+            }
+            ModelHeader header = {};
+            write(StringRef((const char *)&header, sizeof(header)));
+            return true;
+        }
+
+        bool isOpen() const
+        {
+            return out != nullptr;
+        }
+
+        // Only called on one thread, in module order.
+        void addFunction(const ModelEncoder &encoder)
+        {
+            ModelFunctionRecord record;
+            record.name = encoder.getName();
+            for (unsigned table = 0; table < NUM_MODEL_TABLES; table++)
+            {
+                StringRef bytes = encoder.getTable((ModelTable)table);
+                if (table != MODEL_STRINGS)
+                {
+                    align();
+                }
+                record.tables[table].offset = position;
+                record.tables[table].count = bytes.size() / MODEL_ENTRY_SIZES[table];
+                write(bytes);
+            }
+            index.push_back(record);
+            names.push_back(encoder.getNameString().str());
+        }
+
+        bool close(string &error)
+        {
+            vector<unsigned> order(index.size());
+            for (unsigned i = 0; i < order.size(); i++)
+            {
+                order[i] = i;
+            }
+            llvm::stable_sort(order, [this](unsigned left, unsigned right)
+                              { return names[left] < names[right]; });
+
+            align();
+            ModelHeader header = {};
+            header.magic = MODEL_MAGIC;
+            header.version = MODEL_VERSION;
+            header.numFunctions = index.size();
+            header.indexOffset = position;
+            for (unsigned i : order)
+            {
+                write(StringRef((const char *)&index[i], sizeof(ModelFunctionRecord)));
+            }
+            out->pwrite((const char *)&header, sizeof(header), 0);
+            out->close();
+            bool failed = out->has_error();
+            if (failed)
+            {
+                error = out->error().message();
+                out->clear_error();
+            }
+            out.reset();
+            index.clear();
+            names.clear();
+            position = 0;
+            return !failed;
+        }
+    };
+}
+
+#endif
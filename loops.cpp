@@ -0,0 +1,249 @@
+#ifndef RPE_LOOPS_CPP
+#define RPE_LOOPS_CPP
+
+#include "cfg.cpp"
+
+// LLVM dependencies
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Dominators.h"
+
+using namespace llvm;
+using namespace std;
+
+// Loop of the blocks that are in no loop.
+static const unsigned NO_LOOP = ~0u;
+
+namespace
+{
+    /**
+     * Loops of one function in CompactCFG block ids, copied out of LoopInfo and the DominatorTree
+     * so that they stay valid once the pass manager moves on to the next function.
+     * Back edges are the edges whose target dominates their source. Irreducible cycles have no
+     * such edge, so they are cut at the edges a depth first search finds retreating, and each
+     * target of those becomes the header of an extra loop without exits, nested in the innermost
+     * natural loop around it. Every back edge ends at a header and starts at one of its latches.
+     */
+    class LoopForest
+    {
+    private:
+        vector<BLOCK_ID> headers;        // Indexed by loop. Natural loops come first, in preorder.
+        vector<unsigned> parentLoops;
+        vector<unsigned> depths;         // 1 for outermost loops
+        vector<vector<BLOCK_ID>> latches;
+        vector<vector<EDGE>> exits;      // Edges from a block of the loop to a block outside it
+        vector<unsigned> innermostLoops; // Indexed by block
+        vector<unsigned> headedLoops;    // Indexed by block, NO_LOOP for blocks that head no loop
+        vector<EDGE> backEdges;          // (latch, header), sorted
+        unsigned maxDepth;
+
+        unsigned addLoop(BLOCK_ID header, unsigned parent)
+        {
+            unsigned loop = headers.size();
+            headers.push_back(header);
+            parentLoops.push_back(parent);
+            unsigned depth = parent == NO_LOOP ? 1 : depths[parent] + 1;
+            depths.push_back(depth);
+            maxDepth = max(maxDepth, depth);
+            latches.emplace_back();
+            exits.emplace_back();
+            headedLoops[header] = loop;
+            return loop;
+        }
+
+        void addBackEdge(BLOCK_ID latch, unsigned loop)
+        {
+            latches[loop].push_back(latch);
+            backEdges.push_back(make_pair(latch, headers[loop]));
+        }
+
+        // Retreating edges of the graph left once the natural back edges are gone.
+        void cutIrreducibleCycles(const CompactCFG &cfg)
+        {
+            const CSRGraph &graph = cfg.getSuccessorGraph();
+            vector<char> state(cfg.size(), 0); // 0 unvisited, 1 on the DFS stack, 2 finished
+            vector<pair<BLOCK_ID, unsigned>> workList;
+            vector<EDGE> retreating;
+
+            state[cfg.getRoot()] = 1;
+            workList.push_back(make_pair(cfg.getRoot(), 0));
+            while (!workList.empty())
+            {
+                BLOCK_ID node = workList.back().first;
+                unsigned nextChild = workList.back().second;
+                ArrayRef<BLOCK_ID> children = graph.getChildren(node);
+                if (nextChild == children.size())
+                {
+                    state[node] = 2;
+                    workList.pop_back();
+                    continue;
+                }
+                workList.back().second++;
+                BLOCK_ID child = children[nextChild];
+                if (isBackEdge(node, child))
+                {
+                    continue;
+                }
+                if (state[child] == 1)
+                {
+                    retreating.push_back(make_pair(node, child));
+                }
+                else if (state[child] == 0)
+                {
+                    state[child] = 1;
+                    workList.push_back(make_pair(child, 0));
+                }
+            }
+
+            for (EDGE edge : retreating)
+            {
+                BLOCK_ID header = edge.second;
+                unsigned loop = headedLoops[header];
+                if (loop == NO_LOOP)
+                {
+                    loop = addLoop(header, innermostLoops[header]);
+                }
+                if (find(latches[loop].begin(), latches[loop].end(), edge.first) == latches[loop].end())
+                {
+                    latches[loop].push_back(edge.first);
+                }
+            }
+            // The natural back edges are already sorted, so a merge keeps the whole list sorted.
+            llvm::sort(retreating);
+            retreating.erase(unique(retreating.begin(), retreating.end()), retreating.end());
+            unsigned numNatural = backEdges.size();
+            backEdges.insert(backEdges.end(), retreating.begin(), retreating.end());
+            inplace_merge(backEdges.begin(), backEdges.begin() + numNatural, backEdges.end());
+        }
+
+    public:
+        LoopForest()
+        {
+            maxDepth = 0;
+        }
+
+        void build(const CompactCFG &cfg, const LoopInfo &loopInfo, const DominatorTree &domTree)
+        {
+            headers.clear();
+            parentLoops.clear();
+            depths.clear();
+            latches.clear();
+            exits.clear();
+            backEdges.clear();
+            maxDepth = 0;
+            innermostLoops.assign(cfg.size(), NO_LOOP);
+            headedLoops.assign(cfg.size(), NO_LOOP);
+
+            DenseMap<const Loop *, unsigned> loopIds;
+            for (const Loop *loop : loopInfo.getLoopsInPreorder())
+            {
+                const Loop *parent = loop->getParentLoop();
+                unsigned id = addLoop(cfg.getId(loop->getHeader()), parent == nullptr ? NO_LOOP : loopIds.lookup(parent));
+                loopIds[loop] = id;
+
+                SmallVector<Loop::Edge, 8> exitEdges;
+                loop->getExitEdges(exitEdges);
+                for (const Loop::Edge &edge : exitEdges)
+                {
+                    exits[id].push_back(make_pair(cfg.getId(edge.first), cfg.getId(edge.second)));
+                }
+            }
+
+            vector<EDGE> naturalBackEdges;
+            for (BLOCK_ID node = 0; node < cfg.size(); node++)
+            {
+                const BasicBlock *basicBlock = cfg.getBlock(node);
+                const Loop *loop = loopInfo.getLoopFor(basicBlock);
+                if (loop != nullptr)
+                {
+                    innermostLoops[node] = loopIds.lookup(loop);
+                }
+                if (!domTree.isReachableFromEntry(basicBlock))
+                {
+                    continue;
+                }
+                for (BLOCK_ID child : cfg.getSuccessors(node))
+                {
+                    if (headedLoops[child] != NO_LOOP && domTree.dominates(cfg.getBlock(child), basicBlock))
+                    {
+                        naturalBackEdges.push_back(make_pair(node, child));
+                    }
+                }
+            }
+            // A switch can reach the header through several cases; that is still one back edge.
+            llvm::sort(naturalBackEdges);
+            naturalBackEdges.erase(unique(naturalBackEdges.begin(), naturalBackEdges.end()), naturalBackEdges.end());
+            for (EDGE edge : naturalBackEdges)
+            {
+                addBackEdge(edge.first, headedLoops[edge.second]);
+            }
+            cutIrreducibleCycles(cfg);
+        }
+
+        unsigned size() const
+        {
+            return headers.size();
+        }
+        bool empty() const
+        {
+            return headers.empty();
+        }
+        unsigned getMaxDepth() const
+        {
+            return maxDepth;
+        }
+
+        BLOCK_ID getHeader(unsigned loop) const
+        {
+            return headers[loop];
+        }
+        unsigned getParent(unsigned loop) const
+        {
+            return parentLoops[loop];
+        }
+        unsigned getDepth(unsigned loop) const
+        {
+            return depths[loop];
+        }
+        ArrayRef<BLOCK_ID> getLatches(unsigned loop) const
+        {
+            return latches[loop];
+        }
+        ArrayRef<EDGE> getExits(unsigned loop) const
+        {
+            return exits[loop];
+        }
+        bool isExitEdge(unsigned loop, BLOCK_ID from, BLOCK_ID to) const
+        {
+            return find(exits[loop].begin(), exits[loop].end(), make_pair(from, to)) != exits[loop].end();
+        }
+
+        bool isHeader(BLOCK_ID node) const
+        {
+            return node < headedLoops.size() && headedLoops[node] != NO_LOOP;
+        }
+        // Loop headed by node, or NO_LOOP.
+        unsigned getHeadedLoop(BLOCK_ID node) const
+        {
+            return headedLoops[node];
+        }
+        // Innermost natural loop containing node, or NO_LOOP.
+        unsigned getLoopFor(BLOCK_ID node) const
+        {
+            return innermostLoops[node];
+        }
+
+        ArrayRef<EDGE> getBackEdges() const
+        {
+            return backEdges;
+        }
+        bool isBackEdge(BLOCK_ID from, BLOCK_ID to) const
+        {
+            return binary_search(backEdges.begin(), backEdges.end(), make_pair(from, to));
+        }
+    };
+}
+
+#endif
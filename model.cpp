@@ -0,0 +1,738 @@
+#ifndef RPE_MODEL_CPP
+#define RPE_MODEL_CPP
+
+// STL dependencies
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// POSIX dependencies
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+/**
+ * Model files written by -rpe-model-dir, one per module. They are laid out to be mapped and
+ * used in place: every record has a fixed width, every table starts 8 byte aligned, and all
+ * numbers are little endian. The reader below only needs the standard library and POSIX, so
+ * tools that load the models do not have to link against LLVM.
+ *
+ * A file is a ModelHeader, the tables of every function, and an index of one
+ * ModelFunctionRecord per function, sorted by name, at ModelHeader::indexOffset. A function
+ * record holds the file offset and entry count of each of the function's tables:
+ *   MODEL_BLOCKS       ModelBlockRecord per block; blocks are referred to by index
+ *   MODEL_CALLEES      ModelString per called function, in ranges of the blocks
+ *   MODEL_SUCCESSORS   ModelSuccessorRecord per CFG edge, in ranges of the blocks
+ *   MODEL_BLOCK_IDS    uint32_t per block id in the ranges of blocks and loops
+ *   MODEL_LOOPS        ModelLoopRecord per loop; parents come before their children
+ *   MODEL_PATHS        ModelPathsRecord per path numbering
+ *   MODEL_PATH_IDS     uint64_t per path id, ascending in the ranges of the numberings
+ *   MODEL_VALUES       ModelValueRecord per value of the DDG
+ *   MODEL_DEPENDENCES  ModelDependenceRecord per DDG edge, in ranges of the values
+ *   MODEL_CHAINS       ModelChainRecord per provenance chain
+ *   MODEL_PROVENANCE   ModelProvenanceRecord per provenance node, in ranges of the chains
+ *   MODEL_STRINGS      bytes of the strings of the function, referred to by ModelString
+ * Path ids follow the Ball-Larus numbering of the acyclic graph between source and target: the
+ * children of a block are numbered in order, each after all the paths through the ones before it.
+ */
+
+static const uint32_t MODEL_MAGIC = 0x4d455052; // "RPEM"
+static const uint32_t MODEL_VERSION = 4;
+
+// Tables start at multiples of this.
+static const uint64_t MODEL_ALIGNMENT = 8;
+
+// Target of a numbering whose paths end at any block without children.
+static const uint32_t MODEL_ANY_SINK = ~0u;
+
+// Parent of an outermost loop.
+static const uint32_t MODEL_NO_LOOP = ~0u;
+
+enum ModelTable
+{
+    MODEL_BLOCKS,
+    MODEL_CALLEES,
+    MODEL_SUCCESSORS,
+    MODEL_BLOCK_IDS,
+    MODEL_LOOPS,
+    MODEL_PATHS,
+    MODEL_PATH_IDS,
+    MODEL_VALUES,
+    MODEL_DEPENDENCES,
+    MODEL_CHAINS,
+    MODEL_PROVENANCE,
+    MODEL_STRINGS,
+    NUM_MODEL_TABLES
+};
+
+enum ModelBlockFlags
+{
+    MODEL_ROOT_BLOCK = 1,
+    MODEL_CONDITIONAL_BLOCK = 2,
+    MODEL_INLINE_ASSEMBLY = 4
+};
+
+// How control reaches a successor, from the terminator of the block.
+enum ModelSuccessorKind
+{
+    MODEL_NEXT_EDGE,        // Unconditional branch
+    MODEL_TRUE_EDGE,        // Conditional branch taken
+    MODEL_FALSE_EDGE,       // Conditional branch not taken
+    MODEL_CASE_EDGE,        // A case of a switch, or a handler of a catchswitch
+    MODEL_DEFAULT_EDGE,     // Default of a switch, or the fallthrough of a callbr
+    MODEL_NORMAL_EDGE,      // Normal return of an invoke
+    MODEL_UNWIND_EDGE,      // Exception edge
+    MODEL_INDIRECT_EDGE,    // Target of an indirectbr, or an indirect target of a callbr
+    NUM_MODEL_SUCCESSOR_KINDS
+};
+
+// Budgets a function ran out of, on its canonical numbering. Its ids are then only some of its
+// paths, its loops may be left folded into their header, and numPaths stands for the rest.
+enum ModelBudgetFlags
+{
+    MODEL_THRESHOLD_BUDGET = 1, // Paths only counted, as there were more than -rpe-path-threshold
+    MODEL_PATH_BUDGET = 2,
+    MODEL_LENGTH_BUDGET = 4,
+    MODEL_DEPTH_BUDGET = 8,
+    MODEL_TIME_BUDGET = 16
+};
+
+enum ModelPathKind
+{
+    MODEL_CANONICAL_PATHS, // The ids are the canonical paths the pass emitted
+    MODEL_LOOP_PATHS       // Paths through a loop body, from its header to one latch. Every id is a path
+};
+
+struct ModelString
+{
+    uint32_t offset; // In the MODEL_STRINGS table of the function
+    uint32_t size;
+};
+
+struct ModelRange
+{
+    uint32_t first;
+    uint32_t count;
+};
+
+struct ModelHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t numFunctions;
+    uint64_t indexOffset;
+    uint64_t reserved;
+};
+
+struct ModelTableRecord
+{
+    uint64_t offset; // From the start of the file
+    uint64_t count;  // Entries, not bytes
+};
+
+struct ModelFunctionRecord
+{
+    ModelString name;
+    ModelTableRecord tables[NUM_MODEL_TABLES];
+};
+
+struct ModelBlockRecord
+{
+    ModelString label;
+    uint32_t flags;        // ModelBlockFlags
+    ModelRange callees;    // Into MODEL_CALLEES
+    ModelRange successors; // Into MODEL_SUCCESSORS, in the terminator's order
+    ModelRange children;   // Into MODEL_BLOCK_IDS, the successors without loop back edges
+};
+
+struct ModelSuccessorRecord
+{
+    uint32_t block;
+    uint32_t kind; // ModelSuccessorKind
+};
+
+struct ModelLoopRecord
+{
+    uint32_t header;
+    uint32_t parent;    // MODEL_NO_LOOP for outermost loops
+    ModelRange latches; // Into MODEL_BLOCK_IDS
+};
+
+struct ModelPathsRecord
+{
+    uint32_t kind; // ModelPathKind
+    uint32_t source;
+    uint32_t target; // MODEL_ANY_SINK when any block without children ends a path
+    uint32_t budgets; // ModelBudgetFlags of canonical numberings, 0 for loop paths
+    uint64_t numPaths;
+    uint64_t firstId; // Into MODEL_PATH_IDS
+    uint64_t numIds;
+};
+
+struct ModelValueRecord
+{
+    ModelString name;
+    ModelString type;
+    ModelRange edges; // Into MODEL_DEPENDENCES
+};
+
+struct ModelDependenceRecord
+{
+    uint32_t target; // Index of a value
+    ModelString label;
+};
+
+struct ModelChainRecord
+{
+    uint64_t pathId;  // Canonical path the chain was built from
+    ModelRange nodes; // Into MODEL_PROVENANCE
+};
+
+struct ModelProvenanceRecord
+{
+    ModelString action;
+    ModelString artifact;
+    ModelString id;
+};
+
+static_assert(sizeof(ModelHeader) == 32, "ModelHeader has padding");
+static_assert(sizeof(ModelFunctionRecord) == 8 + 16 * NUM_MODEL_TABLES, "ModelFunctionRecord has padding");
+static_assert(sizeof(ModelBlockRecord) == 36, "ModelBlockRecord has padding");
+static_assert(sizeof(ModelPathsRecord) == 40, "ModelPathsRecord has padding");
+static_assert(sizeof(ModelDependenceRecord) == 12, "ModelDependenceRecord has padding");
+static_assert(sizeof(ModelChainRecord) == 16, "ModelChainRecord has padding");
+
+// Width of the entries of each table.
+static const uint64_t MODEL_ENTRY_SIZES[NUM_MODEL_TABLES] = {
+    sizeof(ModelBlockRecord), sizeof(ModelString), sizeof(ModelSuccessorRecord), sizeof(uint32_t), sizeof(ModelLoopRecord),
+    sizeof(ModelPathsRecord), sizeof(uint64_t), sizeof(ModelValueRecord), sizeof(ModelDependenceRecord),
+    sizeof(ModelChainRecord), sizeof(ModelProvenanceRecord), sizeof(char)};
+
+namespace
+{
+    // A table of a mapped file, used in place.
+    template <typename T>
+    class ModelSpan
+    {
+    private:
+        const T *items;
+        uint64_t count;
+
+    public:
+        ModelSpan() : items(nullptr), count(0) {}
+        ModelSpan(const T *first, uint64_t size) : items(first), count(size) {}
+
+        const T *begin() const
+        {
+            return items;
+        }
+        const T *end() const
+        {
+            return items + count;
+        }
+        uint64_t size() const
+        {
+            return count;
+        }
+        bool empty() const
+        {
+            return count == 0;
+        }
+        const T &operator[](uint64_t i) const
+        {
+            return items[i];
+        }
+        ModelSpan<T> slice(uint64_t first, uint64_t size) const
+        {
+            return ModelSpan<T>(items + first, size);
+        }
+    };
+
+    /**
+     * The model of one function, read in place from the file it belongs to.
+     */
+    class ModelFunction
+    {
+    private:
+        const char *file;
+        const ModelFunctionRecord *record;
+
+        template <typename T>
+        ModelSpan<T> getTable(ModelTable table) const
+        {
+            return ModelSpan<T>((const T *)(file + record->tables[table].offset), record->tables[table].count);
+        }
+
+        bool endsPath(const ModelPathsRecord &numbering, uint32_t node) const
+        {
+            return node == numbering.target || (numbering.target == MODEL_ANY_SINK && getChildren(node).empty());
+        }
+
+    public:
+        ModelFunction() : file(nullptr), record(nullptr) {}
+        ModelFunction(const char *data, const ModelFunctionRecord *functionRecord) : file(data), record(functionRecord) {}
+
+        string getString(ModelString text) const
+        {
+            return string(file + record->tables[MODEL_STRINGS].offset + text.offset, text.size);
+        }
+        string getName() const
+        {
+            return getString(record->name);
+        }
+
+        ModelSpan<ModelBlockRecord> getBlocks() const
+        {
+            return getTable<ModelBlockRecord>(MODEL_BLOCKS);
+        }
+        ModelSpan<ModelLoopRecord> getLoops() const
+        {
+            return getTable<ModelLoopRecord>(MODEL_LOOPS);
+        }
+        ModelSpan<ModelPathsRecord> getPaths() const
+        {
+            return getTable<ModelPathsRecord>(MODEL_PATHS);
+        }
+        ModelSpan<ModelValueRecord> getValues() const
+        {
+            return getTable<ModelValueRecord>(MODEL_VALUES);
+        }
+        ModelSpan<ModelChainRecord> getChains() const
+        {
+            return getTable<ModelChainRecord>(MODEL_CHAINS);
+        }
+
+        ModelSpan<ModelString> getCallees(const ModelBlockRecord &block) const
+        {
+            return getTable<ModelString>(MODEL_CALLEES).slice(block.callees.first, block.callees.count);
+        }
+        ModelSpan<ModelSuccessorRecord> getSuccessors(const ModelBlockRecord &block) const
+        {
+            return getTable<ModelSuccessorRecord>(MODEL_SUCCESSORS).slice(block.successors.first, block.successors.count);
+        }
+        ModelSpan<uint32_t> getBlockIds(ModelRange range) const
+        {
+            return getTable<uint32_t>(MODEL_BLOCK_IDS).slice(range.first, range.count);
+        }
+        ModelSpan<uint32_t> getChildren(uint32_t block) const
+        {
+            return getBlockIds(getBlocks()[block].children);
+        }
+        ModelSpan<uint64_t> getPathIds(const ModelPathsRecord &numbering) const
+        {
+            return getTable<uint64_t>(MODEL_PATH_IDS).slice(numbering.firstId, numbering.numIds);
+        }
+        ModelSpan<ModelDependenceRecord> getEdges(const ModelValueRecord &value) const
+        {
+            return getTable<ModelDependenceRecord>(MODEL_DEPENDENCES).slice(value.edges.first, value.edges.count);
+        }
+        ModelSpan<ModelProvenanceRecord> getNodes(const ModelChainRecord &chain) const
+        {
+            return getTable<ModelProvenanceRecord>(MODEL_PROVENANCE).slice(chain.nodes.first, chain.nodes.count);
+        }
+
+        // Whether the pass emitted path id of a numbering, with a binary search.
+        bool hasPath(const ModelPathsRecord &numbering, uint64_t id) const
+        {
+            ModelSpan<uint64_t> ids = getPathIds(numbering);
+            const uint64_t *found = lower_bound(ids.begin(), ids.end(), id);
+            return found != ids.end() && *found == id;
+        }
+
+        // Paths from every block to the target of a numbering, 0 for blocks the source does not reach.
+        void countPaths(const ModelPathsRecord &numbering, vector<uint64_t> &numPaths) const
+        {
+            uint64_t numBlocks = getBlocks().size();
+            numPaths.assign(numBlocks, 0);
+            vector<bool> seen(numBlocks, false);
+            vector<pair<uint32_t, uint32_t>> workList;
+            seen[numbering.source] = true;
+            workList.push_back(make_pair(numbering.source, 0u));
+            while (!workList.empty())
+            {
+                uint32_t node = workList.back().first;
+                uint32_t nextChild = workList.back().second;
+                ModelSpan<uint32_t> children = getChildren(node);
+                if (endsPath(numbering, node))
+                {
+                    numPaths[node] = 1;
+                    workList.pop_back();
+                    continue;
+                }
+                if (nextChild == children.size())
+                {
+                    for (uint32_t child : children)
+                    {
+                        // Saturates like the pass does.
+                        uint64_t total = numPaths[node] + numPaths[child];
+                        numPaths[node] = total < numPaths[child] ? UINT64_MAX : total;
+                    }
+                    workList.pop_back();
+                    continue;
+                }
+                workList.back().second++;
+                uint32_t child = children[nextChild];
+                if (!seen[child])
+                {
+                    seen[child] = true;
+                    workList.push_back(make_pair(child, 0u));
+                }
+            }
+        }
+
+        // Rebuilds the blocks of path id of a numbering, given the counts of countPaths(). Fails if the id is out of range.
+        bool regeneratePath(const ModelPathsRecord &numbering, const vector<uint64_t> &numPaths, uint64_t id, vector<uint32_t> &path) const
+        {
+            if (id >= numbering.numPaths || numPaths.size() != getBlocks().size())
+            {
+                return false;
+            }
+            path.clear();
+            uint32_t node = numbering.source;
+            path.push_back(node);
+            while (!endsPath(numbering, node))
+            {
+                // Children are numbered in order, so the path continues through the child whose range holds the id.
+                ModelSpan<uint32_t> children = getChildren(node);
+                uint64_t i = 0;
+                while (i < children.size() && id >= numPaths[children[i]])
+                {
+                    id -= numPaths[children[i]];
+                    i++;
+                }
+                if (i == children.size())
+                {
+                    return false;
+                }
+                node = children[i];
+                path.push_back(node);
+            }
+            return true;
+        }
+    };
+
+    /**
+     * Index of a model file held in memory, usually mapped by MappedModelFile. Opening checks
+     * the header and the bounds of the index. A function is checked when it is looked up,
+     * in time linear in its own size, so a corrupt function cannot send a reader outside
+     * the file and the rest of the file is never touched.
+     */
+    class ModelFile
+    {
+    private:
+        const char *data;
+        uint64_t size;
+        const ModelFunctionRecord *index;
+        uint64_t numFunctions;
+        string error;
+
+        bool fail(const string &message)
+        {
+            error = message;
+            return false;
+        }
+
+        bool isTableInBounds(const ModelTableRecord &table, ModelTable kind) const
+        {
+            uint64_t entrySize = MODEL_ENTRY_SIZES[kind];
+            if (table.offset > size || table.count > (size - table.offset) / entrySize)
+            {
+                return false;
+            }
+            return kind == MODEL_STRINGS || table.offset % MODEL_ALIGNMENT == 0;
+        }
+
+        static bool isRangeInBounds(ModelRange range, uint64_t count)
+        {
+            return range.first <= count && range.count <= count - range.first;
+        }
+
+        static bool isStringInBounds(ModelString text, uint64_t numBytes)
+        {
+            return text.offset <= numBytes && text.size <= numBytes - text.offset;
+        }
+
+        bool isConsistent(const ModelFunctionRecord &record) const
+        {
+            for (unsigned table = 0; table < NUM_MODEL_TABLES; table++)
+            {
+                if (!isTableInBounds(record.tables[table], (ModelTable)table))
+                {
+                    return false;
+                }
+            }
+            ModelFunction function(data, &record);
+            uint64_t numBytes = record.tables[MODEL_STRINGS].count;
+            uint64_t numBlocks = record.tables[MODEL_BLOCKS].count;
+            uint64_t numBlockIds = record.tables[MODEL_BLOCK_IDS].count;
+            uint64_t numLoops = record.tables[MODEL_LOOPS].count;
+            uint64_t numValues = record.tables[MODEL_VALUES].count;
+            if (!isStringInBounds(record.name, numBytes) || numBlockIds > UINT32_MAX)
+            {
+                return false;
+            }
+
+            for (const ModelBlockRecord &block : function.getBlocks())
+            {
+                if (!isStringInBounds(block.label, numBytes) || !isRangeInBounds(block.callees, record.tables[MODEL_CALLEES].count) ||
+                    !isRangeInBounds(block.successors, record.tables[MODEL_SUCCESSORS].count) || !isRangeInBounds(block.children, numBlockIds))
+                {
+                    return false;
+                }
+                for (const ModelSuccessorRecord &successor : function.getSuccessors(block))
+                {
+                    if (successor.block >= numBlocks || successor.kind >= NUM_MODEL_SUCCESSOR_KINDS)
+                    {
+                        return false;
+                    }
+                }
+                for (ModelString callee : function.getCallees(block))
+                {
+                    if (!isStringInBounds(callee, numBytes))
+                    {
+                        return false;
+                    }
+                }
+            }
+            // Checking the whole block id table at once covers the ranges of every block and loop.
+            for (uint32_t block : function.getBlockIds(ModelRange{0, (uint32_t)numBlockIds}))
+            {
+                if (block >= numBlocks)
+                {
+                    return false;
+                }
+            }
+            for (const ModelLoopRecord &loop : function.getLoops())
+            {
+                if (loop.header >= numBlocks || (loop.parent != MODEL_NO_LOOP && loop.parent >= numLoops) ||
+                    !isRangeInBounds(loop.latches, numBlockIds))
+                {
+                    return false;
+                }
+            }
+            uint64_t numPathIds = record.tables[MODEL_PATH_IDS].count;
+            for (const ModelPathsRecord &numbering : function.getPaths())
+            {
+                if (numbering.source >= numBlocks || (numbering.target != MODEL_ANY_SINK && numbering.target >= numBlocks) ||
+                    numbering.firstId > numPathIds || numbering.numIds > numPathIds - numbering.firstId)
+                {
+                    return false;
+                }
+            }
+            for (const ModelValueRecord &value : function.getValues())
+            {
+                if (!isStringInBounds(value.name, numBytes) || !isStringInBounds(value.type, numBytes) ||
+                    !isRangeInBounds(value.edges, record.tables[MODEL_DEPENDENCES].count))
+                {
+                    return false;
+                }
+                for (const ModelDependenceRecord &edge : function.getEdges(value))
+                {
+                    if (edge.target >= numValues || !isStringInBounds(edge.label, numBytes))
+                    {
+                        return false;
+                    }
+                }
+            }
+            for (const ModelChainRecord &chain : function.getChains())
+            {
+                if (!isRangeInBounds(chain.nodes, record.tables[MODEL_PROVENANCE].count))
+                {
+                    return false;
+                }
+                for (const ModelProvenanceRecord &node : function.getNodes(chain))
+                {
+                    if (!isStringInBounds(node.action, numBytes) || !isStringInBounds(node.artifact, numBytes) ||
+                        !isStringInBounds(node.id, numBytes))
+                    {
+                        return false;
+                    }
+                }
+            }
+            return true;
+        }
+
+        // Name of a function of the index, read without checking the rest of the function.
+        bool getIndexedName(uint64_t i, const char *&name, uint32_t &nameSize) const
+        {
+            const ModelFunctionRecord &record = index[i];
+            if (!isTableInBounds(record.tables[MODEL_STRINGS], MODEL_STRINGS) ||
+                !isStringInBounds(record.name, record.tables[MODEL_STRINGS].count))
+            {
+                return false;
+            }
+            name = data + record.tables[MODEL_STRINGS].offset + record.name.offset;
+            nameSize = record.name.size;
+            return true;
+        }
+
+    public:
+        ModelFile()
+        {
+            data = nullptr;
+            size = 0;
+            index = nullptr;
+            numFunctions = 0;
+        }
+
+        // The memory must be 8 byte aligned and outlive the ModelFile.
+        bool open(const char *fileData, uint64_t fileSize)
+        {
+            data = fileData;
+            size = fileSize;
+            index = nullptr;
+            numFunctions = 0;
+            error.clear();
+
+            ModelHeader header;
+            if (size < sizeof(header))
+            {
+                return fail("Not a model file");
+            }
+            memcpy(&header, data, sizeof(header));
+            if (header.magic != MODEL_MAGIC)
+            {
+                return fail("Not a model file, or written on a big endian host");
+            }
+            if (header.version != MODEL_VERSION)
+            {
+                return fail("Unsupported model version " + to_string(header.version));
+            }
+            if ((uintptr_t)data % MODEL_ALIGNMENT != 0)
+            {
+                return fail("Model file is not aligned in memory");
+            }
+            if (header.indexOffset % MODEL_ALIGNMENT != 0 || header.indexOffset > size ||
+                header.numFunctions > (size - header.indexOffset) / sizeof(ModelFunctionRecord))
+            {
+                return fail("Truncated function index");
+            }
+            index = (const ModelFunctionRecord *)(data + header.indexOffset);
+            numFunctions = header.numFunctions;
+            return true;
+        }
+
+        uint64_t getNumFunctions() const
+        {
+            return numFunctions;
+        }
+
+        // The i-th function in name order.
+        bool getFunction(uint64_t i, ModelFunction &function)
+        {
+            if (i >= numFunctions || !isConsistent(index[i]))
+            {
+                return fail("Corrupt function " + to_string(i));
+            }
+            function = ModelFunction(data, &index[i]);
+            return true;
+        }
+
+        // Binary search of the index, which only reads the names it compares against.
+        bool findFunction(const string &name, ModelFunction &function)
+        {
+            uint64_t low = 0;
+            uint64_t high = numFunctions;
+            while (low < high)
+            {
+                uint64_t middle = low + (high - low) / 2;
+                const char *middleName = nullptr;
+                uint32_t middleSize = 0;
+                if (!getIndexedName(middle, middleName, middleSize))
+                {
+                    return fail("Corrupt function " + to_string(middle));
+                }
+                int order = name.compare(0, name.size(), middleName, middleSize);
+                if (order == 0)
+                {
+                    return getFunction(middle, function);
+                }
+                if (order > 0)
+                {
+                    low = middle + 1;
+                }
+                else
+                {
+                    high = middle;
+                }
+            }
+            return false;
+        }
+
+        // Empty unless a lookup found the file corrupt.
+        const string &getError() const
+        {
+            return error;
+        }
+    };
+
+    /**
+     * A model file mapped read-only into memory. Pages are only read when a function uses them.
+     */
+    class MappedModelFile
+    {
+    private:
+        void *mapping;
+        size_t size;
+
+    public:
+        MappedModelFile() : mapping(nullptr), size(0) {}
+        MappedModelFile(const MappedModelFile &) = delete;
+        MappedModelFile &operator=(const MappedModelFile &) = delete;
+        ~MappedModelFile()
+        {
+            unmap();
+        }
+
+        bool map(const string &fileName)
+        {
+            unmap();
+            int fd = ::open(fileName.c_str(), O_RDONLY);
+            if (fd < 0)
+            {
+                return false;
+            }
+            struct stat status;
+            if (fstat(fd, &status) != 0 || status.st_size == 0)
+            {
+                close(fd);
+                return false;
+            }
+            void *address = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+            if (address == MAP_FAILED)
+            {
+                return false;
+            }
+            mapping = address;
+            size = status.st_size;
+            return true;
+        }
+
+        void unmap()
+        {
+            if (mapping != nullptr)
+            {
+                munmap(mapping, size);
+            }
+            mapping = nullptr;
+            size = 0;
+        }
+
+        const char *getData() const
+        {
+            return (const char *)mapping;
+        }
+        size_t getSize() const
+        {
+            return size;
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,261 @@
+// Converts a model file written by -rpe-model-dir to JSON, either whole or only the named functions.
+// Usage: rpe-model2json <model file> [-o output file] [function...]
+
+#include "model.cpp"
+
+#include <fstream>
+#include <iostream>
+#include <memory>
+
+// JSON dependencies
+#include <jsoncpp/json/json.h>
+
+using namespace std;
+
+namespace
+{
+    static Json::Value getBlockLabels(const ModelFunction &model, ModelSpan<uint32_t> blocks)
+    {
+        Json::Value labels(Json::arrayValue);
+        for (uint32_t block : blocks)
+        {
+            labels.append(model.getString(model.getBlocks()[block].label));
+        }
+        return labels;
+    }
+
+    static Json::Value getBlockLabels(const ModelFunction &model, const vector<uint32_t> &blocks)
+    {
+        return getBlockLabels(model, ModelSpan<uint32_t>(blocks.data(), blocks.size()));
+    }
+
+    static const char *const SUCCESSOR_KIND_NAMES[NUM_MODEL_SUCCESSOR_KINDS] = {
+        "next", "true", "false", "case", "default", "normal", "unwind", "indirect"};
+
+    // Of the bits of ModelBudgetFlags, in order.
+    static const unsigned NUM_BUDGET_NAMES = 5;
+    static const char *const BUDGET_NAMES[NUM_BUDGET_NAMES] = {"threshold", "paths", "length", "depth", "time"};
+
+    static Json::Value convertPaths(const ModelFunction &model, const ModelPathsRecord &paths)
+    {
+        Json::Value converted(Json::objectValue);
+        converted["kind"] = paths.kind == MODEL_CANONICAL_PATHS ? "canonical" : "loop";
+        converted["source"] = model.getString(model.getBlocks()[paths.source].label);
+        if (paths.target == MODEL_ANY_SINK)
+        {
+            converted["target"] = Json::Value();
+        }
+        else
+        {
+            converted["target"] = model.getString(model.getBlocks()[paths.target].label);
+        }
+        converted["count"] = Json::Value((Json::UInt64)paths.numPaths);
+        if (paths.budgets != 0)
+        {
+            Json::Value budgets(Json::arrayValue);
+            for (unsigned budget = 0; budget < NUM_BUDGET_NAMES; budget++)
+            {
+                if (paths.budgets & (1u << budget))
+                {
+                    budgets.append(BUDGET_NAMES[budget]);
+                }
+            }
+            converted["approximated"] = budgets;
+        }
+
+        // Loop bodies are listed by their count only, as every id below it is a path.
+        Json::Value list(Json::arrayValue);
+        vector<uint64_t> numPaths;
+        model.countPaths(paths, numPaths);
+        vector<uint32_t> blocks;
+        for (uint64_t id : model.getPathIds(paths))
+        {
+            Json::Value path(Json::objectValue);
+            path["id"] = Json::Value((Json::UInt64)id);
+            if (model.regeneratePath(paths, numPaths, id, blocks))
+            {
+                path["blocks"] = getBlockLabels(model, blocks);
+            }
+            list.append(path);
+        }
+        converted["paths"] = list;
+        return converted;
+    }
+
+    static Json::Value convertFunction(const ModelFunction &model)
+    {
+        Json::Value function(Json::objectValue);
+        function["name"] = model.getName();
+
+        Json::Value blocks(Json::arrayValue);
+        for (const ModelBlockRecord &block : model.getBlocks())
+        {
+            Json::Value converted(Json::objectValue);
+            converted["label"] = model.getString(block.label);
+            converted["root"] = (block.flags & MODEL_ROOT_BLOCK) != 0;
+            converted["conditional"] = (block.flags & MODEL_CONDITIONAL_BLOCK) != 0;
+            converted["inlineAssembly"] = (block.flags & MODEL_INLINE_ASSEMBLY) != 0;
+            Json::Value callees(Json::arrayValue);
+            for (ModelString callee : model.getCallees(block))
+            {
+                callees.append(model.getString(callee));
+            }
+            converted["callees"] = callees;
+            Json::Value successors(Json::arrayValue);
+            Json::Value successorKinds(Json::arrayValue);
+            for (const ModelSuccessorRecord &successor : model.getSuccessors(block))
+            {
+                successors.append(model.getString(model.getBlocks()[successor.block].label));
+                successorKinds.append(SUCCESSOR_KIND_NAMES[successor.kind]);
+            }
+            converted["successors"] = successors;
+            converted["successorKinds"] = successorKinds;
+            converted["dagSuccessors"] = getBlockLabels(model, model.getBlockIds(block.children));
+            blocks.append(converted);
+        }
+        function["blocks"] = blocks;
+
+        Json::Value loops(Json::arrayValue);
+        for (const ModelLoopRecord &loop : model.getLoops())
+        {
+            Json::Value converted(Json::objectValue);
+            converted["header"] = model.getString(model.getBlocks()[loop.header].label);
+            converted["parent"] = loop.parent == MODEL_NO_LOOP ? Json::Value() : Json::Value(loop.parent);
+            converted["latches"] = getBlockLabels(model, model.getBlockIds(loop.latches));
+            loops.append(converted);
+        }
+        function["loops"] = loops;
+
+        Json::Value paths(Json::arrayValue);
+        for (const ModelPathsRecord &numbering : model.getPaths())
+        {
+            paths.append(convertPaths(model, numbering));
+        }
+        function["paths"] = paths;
+
+        Json::Value ddg(Json::arrayValue);
+        ModelSpan<ModelValueRecord> values = model.getValues();
+        for (const ModelValueRecord &value : values)
+        {
+            Json::Value converted(Json::objectValue);
+            converted["name"] = model.getString(value.name);
+            converted["type"] = model.getString(value.type);
+            Json::Value edges(Json::arrayValue);
+            for (const ModelDependenceRecord &edge : model.getEdges(value))
+            {
+                Json::Value convertedEdge(Json::objectValue);
+                convertedEdge["target"] = model.getString(values[edge.target].name);
+                convertedEdge["label"] = model.getString(edge.label);
+                edges.append(convertedEdge);
+            }
+            converted["edges"] = edges;
+            ddg.append(converted);
+        }
+        function["ddg"] = ddg;
+
+        Json::Value provenance(Json::arrayValue);
+        for (const ModelChainRecord &chain : model.getChains())
+        {
+            Json::Value converted(Json::objectValue);
+            converted["pathId"] = Json::Value((Json::UInt64)chain.pathId);
+            Json::Value nodes(Json::arrayValue);
+            for (const ModelProvenanceRecord &node : model.getNodes(chain))
+            {
+                Json::Value convertedNode(Json::objectValue);
+                convertedNode["action"] = model.getString(node.action);
+                convertedNode["artifact"] = model.getString(node.artifact);
+                convertedNode["id"] = model.getString(node.id);
+                nodes.append(convertedNode);
+            }
+            converted["nodes"] = nodes;
+            provenance.append(converted);
+        }
+        function["provenance"] = provenance;
+        return function;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        cerr << "Usage: " << argv[0] << " <model file> [-o output file] [function...]\n";
+        return 1;
+    }
+    string outputName;
+    vector<string> functionNames;
+    for (int i = 2; i < argc; i++)
+    {
+        if (string(argv[i]) == "-o" && i + 1 < argc)
+        {
+            outputName = argv[++i];
+        }
+        else
+        {
+            functionNames.push_back(argv[i]);
+        }
+    }
+
+    MappedModelFile mapping;
+    if (!mapping.map(argv[1]))
+    {
+        cerr << "ERROR: Could not map " << argv[1] << "\n";
+        return 1;
+    }
+    ModelFile file;
+    if (!file.open(mapping.getData(), mapping.getSize()))
+    {
+        cerr << "ERROR: " << argv[1] << ": " << file.getError() << "\n";
+        return 1;
+    }
+    Json::Value root(Json::objectValue);
+    root["version"] = MODEL_VERSION;
+    Json::Value functions(Json::arrayValue);
+    ModelFunction model;
+    if (functionNames.empty())
+    {
+        for (uint64_t i = 0; i < file.getNumFunctions(); i++)
+        {
+            if (!file.getFunction(i, model))
+            {
+                break;
+            }
+            functions.append(convertFunction(model));
+        }
+    }
+    else
+    {
+        // Only the named functions are looked up, and the rest of the file is never read.
+        for (const string &name : functionNames)
+        {
+            if (file.findFunction(name, model))
+            {
+                functions.append(convertFunction(model));
+            }
+            else if (file.getError().empty())
+            {
+                cerr << "WARNING: " << argv[1] << " has no function " << name << "\n";
+            }
+        }
+    }
+    if (!file.getError().empty())
+    {
+        cerr << "ERROR: " << argv[1] << ": " << file.getError() << "\n";
+        return 1;
+    }
+    root["functions"] = functions;
+
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "  ";
+    unique_ptr<Json::StreamWriter> writer(builder.newStreamWriter());
+    if (!outputName.empty())
+    {
+        ofstream output(outputName);
+        writer->write(root, &output);
+        output << "\n";
+        return output ? 0 : 1;
+    }
+    writer->write(root, &cout);
+    cout << "\n";
+    return 0;
+}
@@ -1,122 +1,375 @@
 #include "utility.cpp"
+#include "cfg.cpp"
+#include "paths.cpp"
+#include "sink.cpp"
+#include "ddg.cpp"
+#include "loops.cpp"
 #include "abb.cpp"
+#include "encoder.cpp"
+#include "cache.cpp"
+#include "summary.cpp"
+
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/TimeProfiler.h"
+#include "llvm/Support/Timer.h"
+
+#include <chrono>
 
 using namespace llvm;
 using namespace std;
 
+static cl::opt<unsigned long long> PathEnumerationThreshold(
+    "rpe-path-threshold",
+    cl::desc("Only count, without enumerating, the paths of a function, loop or canonical path that has more paths than this"),
+    cl::init(100000));
+
+// Budgets of each function. A function that runs out of one is approximated rather than dropped:
+// what was emitted so far stays, and its path counts and CFG stand for the rest. The defaults only
+// bind on functions that would otherwise stall the build.
+static cl::opt<unsigned long long> MaxFunctionPaths(
+    "rpe-max-paths",
+    cl::desc("Stop enumerating the paths of a function once it emitted this many, canonical and expanded together. "
+             "0 for no limit"),
+    cl::init(1000000));
+
+static cl::opt<unsigned> MaxExpandedPathLength(
+    "rpe-max-path-length",
+    cl::desc("Leave a loop folded into its header when expanding it would make a path longer than this many blocks. "
+             "0 for no limit"),
+    cl::init(10000));
+
+static cl::opt<unsigned> MaxLoopExpansionDepth(
+    "rpe-max-loop-depth",
+    cl::desc("Leave loops nested deeper than this in an expanded path folded into their header. 0 for no limit"),
+    cl::init(8));
+
+static cl::opt<unsigned> FunctionTimeBudget(
+    "rpe-time-budget",
+    cl::desc("Stop enumerating the paths of a function after this many milliseconds. 0 for no limit. "
+             "Functions that run out of time are not cached"),
+    cl::value_desc("ms"),
+    cl::init(60000));
+
+enum PathSinkKind
+{
+    PrintPaths,
+    WritePaths,
+    CountPaths
+};
+
+static cl::opt<PathSinkKind> PathSinkOption(
+    "rpe-path-sink",
+    cl::desc("Where canonical and expanded paths are streamed to"),
+    cl::values(clEnumValN(PrintPaths, "print", "Print every path to stderr"),
+               clEnumValN(WritePaths, "file", "Write every path to the file named by -rpe-path-file"),
+               clEnumValN(CountPaths, "count", "Only report the number of paths of each function")),
+    cl::init(PrintPaths));
+
+static cl::opt<string> PathFileName(
+    "rpe-path-file",
+    cl::desc("Output file of -rpe-path-sink=file"),
+    cl::init("paths.txt"));
+
+static cl::opt<string> ModelDirectory(
+    "rpe-model-dir",
+    cl::desc("Directory a binary model of every module is written to, with the ABB graph, loop paths, DDG and provenance "
+             "edges of each function. Files are named after the module's source file and a hash of its path"),
+    cl::value_desc("dir"),
+    cl::init(""));
+
+static cl::opt<string> CacheDirectory(
+    "rpe-cache-dir",
+    cl::desc("Directory the results of every function are kept in across runs. Functions whose IR did not change are "
+             "not analyzed again"),
+    cl::value_desc("dir"),
+    cl::init(""));
+
+static cl::opt<bool> GenerateProvenance(
+    "rpe-provenance",
+    cl::desc("Build the provenance edges of every canonical path. Calls to functions of the module apply their summaries"),
+    cl::init(false));
+
+static cl::opt<string> CatalogFileName(
+    "rpe-catalog",
+    cl::desc("JSON spec of the functions that show up in provenance edges, and of the object each acts on. "
+             "Without it only open, fopen, read, write, close, fread, fwrite and fclose are covered. "
+             "relevant_functions.json is a broader catalog of about 250 libc functions"),
+    cl::value_desc("file"),
+    cl::init(""));
+
+static cl::opt<bool> DeduplicatePaths(
+    "rpe-dedup-paths",
+    cl::desc("Drop expanded paths that were already emitted for the same function. "
+             "Up to 2^20 distinct paths are remembered per function, after which the rest are kept"),
+    cl::init(false));
+
+static cl::opt<string> CFGDumpDirectory(
+    "rpe-dump-cfg",
+    cl::desc("Directory the CFG of every function is written to as a DOT file, by a background thread. Nothing is drawn by default"),
+    cl::value_desc("dir"),
+    cl::init(""));
+
+enum LogLevel
+{
+    LogErrors,
+    LogSummary,
+    LogStructure,
+    LogPaths
+};
+
+static cl::opt<unsigned> Verbosity(
+    "rpe-verbose",
+    cl::desc("How much is logged: 0 errors only, 1 path counts of each function, 2 its CFG, loops and acyclic graph as well, "
+             "3 every path through each loop body as well. Paths of -rpe-path-sink=print are printed at every level"),
+    cl::init(LogSummary));
+
+static cl::opt<unsigned> AnalysisThreads(
+    "rpe-threads",
+    cl::desc("Number of functions analyzed in parallel, 0 for one per hardware thread. Output stays in module order"),
+    cl::init(1));
+
+// Anything logged below this level is neither formatted nor written.
+static bool isLogging(LogLevel level)
+{
+    return Verbosity >= level;
+}
+
+#define DEBUG_TYPE "rpe"
+
+// Shown by -stats. Counters are atomic, so every thread of -rpe-threads adds to them.
+STATISTIC(NumFunctions, "Functions whose paths were extracted");
+STATISTIC(NumCachedFunctions, "Functions whose results were reused from -rpe-cache-dir");
+STATISTIC(NumBlocks, "Basic blocks");
+STATISTIC(NumEdges, "CFG edges");
+STATISTIC(NumLoops, "Loops, natural and irreducible");
+STATISTIC(NumBackEdges, "Loop back edges");
+STATISTIC(NumCanonicalPaths, "Canonical paths extracted");
+STATISTIC(NumExpandedPaths, "Paths extracted once loops were expanded");
+STATISTIC(NumDDGValues, "DDG nodes");
+STATISTIC(NumDDGEdges, "DDG edges");
+STATISTIC(NumAliasClassLookups, "Alias class lookups of provenance objects");
+STATISTIC(NumProvenanceNodes, "Provenance nodes generated");
+STATISTIC(NumApproximatedFunctions, "Functions that ran out of a budget");
+STATISTIC(NumThresholdHits, "Functions with more paths than -rpe-path-threshold, in all or in a loop or path");
+STATISTIC(NumPathBudgetHits, "Functions that ran out of -rpe-max-paths");
+STATISTIC(NumLengthBudgetHits, "Functions that ran out of -rpe-max-path-length");
+STATISTIC(NumDepthBudgetHits, "Functions that ran out of -rpe-max-loop-depth");
+STATISTIC(NumTimeBudgetHits, "Functions that ran out of -rpe-time-budget");
+
+// Bits of FunctionAnalysis::budgetHits, the same as ModelBudgetFlags.
+enum AnalysisBudget
+{
+    ThresholdBudget = 1,
+    PathBudget = 2,
+    LengthBudget = 4,
+    DepthBudget = 8,
+    TimeBudget = 16,
+    NUM_BUDGETS = 5
+};
+
+static const char *const BUDGET_NAMES[NUM_BUDGETS] = {"threshold", "paths", "length", "depth", "time"};
+
+// Loop body paths regenerated between two reads of the clock.
+static const unsigned DEADLINE_CHECK_INTERVAL = 4096;
+
 namespace
 {
-    vector<string> loopingBlocks;
-    map<string, int> visited;
-    vector<PATH> canonicalPaths;
-    map<string, vector<PATH>> loopingPaths;
-    vector<PATH> instantiatedPaths;
+    RelevantFunctions relevantFunctions;              // Resolved once per module, before any function is analyzed
+    ProvenanceSummaries provenanceSummaries;          // Built once per module with -rpe-provenance, after relevantFunctions
 
-    map<string, string> typeMap;
-    map<string, vector<EDGE>> adjListForDDG;
-    map<string, pair<string, int>> relevantFunctions;
-    
-    set<string> loopAwareVisited;
-    
-    map<string, vector<ProvenanceNode *>> provenanceAdjList;
-    map<string, EDGE> backEdges;
-    
-    GRAPH canonicalAdjList;
-    GRAPH dagAdjList;
-    
-    map<string, string> constantValueFlowMap; // This is the key to static loop analysis
+    /**
+     * Times one phase: in a group of -time-passes, and as an event of -time-trace (-ftime-trace
+     * in clang) with the function or module as its detail. Phases that run inside path extraction,
+     * once per path, are nested and get a group of their own, so neither group counts a time twice.
+     * The timers are shared by every function, so they only run when functions are analyzed one
+     * at a time, and the trace only records the thread that started it.
+     */
+    class PhaseTimer
+    {
+    private:
+        NamedRegionTimer timer;
+        TimeTraceScope trace;
+
+    public:
+        PhaseTimer(StringRef name, StringRef description, StringRef detail, bool perPath = false)
+            : timer(name, description, perPath ? DEBUG_TYPE "-paths" : DEBUG_TYPE,
+                    perPath ? "Relevant path extraction, per path (part of Path extraction)" : "Relevant path extraction",
+                    TimePassesIsEnabled && AnalysisThreads == 1),
+              trace(description, detail)
+        {
+        }
+    };
 
-    static void writeDDGToFile(string fileName)
+    /**
+     * Everything the pass computes for one function. Functions never share a context, so
+     * they can be analyzed concurrently. Output goes either straight to the streams given
+     * to setOutput() or, when none are given, to buffers that flush() writes out later.
+     * The model of the function (ABBs, DDG, acyclic graph, path counts and loop numberings)
+     * does not depend on where the paths go, so it can be built once and kept by the new
+     * pass manager for as long as the function is unchanged.
+     */
+    struct FunctionAnalysis
     {
-        error_code ec;
-        raw_fd_ostream output(fileName, ec);
+        const Function *function;
+        CompactCFG cfg;
+        AugmentedCFG acfgNodes;
+
+        LoopForest loops; // Built from LoopInfo on the pass manager's thread, before the analysis runs
+        vector<bool> loopAwareVisited;
+        CSRGraph dagAdjList;
+
+        BallLarusNumbering canonicalNumbering;                   // Paths from the root block to an exit block
+        map<BLOCK_ID, vector<BallLarusNumbering>> loopingPaths;  // Paths through each loop body, one numbering per back edge
+        PATH_COUNT canonicalPathCount;               // Acyclic paths from the root block to an exit block
+        PATH_COUNT expandedPathCount;                // The same paths once every loop body is expanded in place
+        map<BLOCK_ID, PATH_COUNT> loopingPathCounts; // Acyclic paths through the body of each loop, keyed by its header
+        map<BLOCK_ID, PATH_COUNT> expansionWeights;  // Number of expanded sub-paths each looping block stands for
+        vector<PATH> instantiatedPaths;
+
+        unique_ptr<PathSink> sink;
+        unique_ptr<PathSink> deduplicatingSink;
+        PathSink *pathSink; // Receives every path as soon as it is found
+        unique_ptr<ModelEncoder> modelEncoder; // Only set when the paths go to a model file as well
+        vector<PATH_ID> emittedPathIds;        // Canonical paths given to pathSink, kept for modelEncoder
+
+        ValueDependenceGraph ddg;
+        AliasClasses loadStoreAliases; // Classes of values connected by the store, load and truncate edges of ddg, built on first use
+        ProvenanceStore provenanceNodes; // Owns every node in provenanceAdjList
+        map<string, vector<PROVENANCE_ID>> provenanceAdjList;
+        map<string, string> constantValueFlowMap; // This is the key to static loop analysis
+
+        bool modelBuilt;
+        string modelLog; // What building the model printed, when it was built ahead of the paths
+
+        unsigned budgetHits;      // AnalysisBudget bits of the budgets the function ran out of
+        unsigned modelBudgetHits; // The ones building the model ran out of, kept with modelLog
+        PATH_COUNT emittedPaths;  // Canonical and expanded, against -rpe-max-paths
+        chrono::steady_clock::time_point deadline; // Of -rpe-time-budget
+
+    private:
+        string logBuffer;
+        string pathBuffer;
+        raw_string_ostream bufferedLog;
+        raw_string_ostream bufferedPaths;
+        raw_ostream *logStream;
+        raw_ostream *pathStream;
+
+    public:
+        FunctionAnalysis(const Function &currentFunction)
+            : bufferedLog(logBuffer), bufferedPaths(pathBuffer)
+        {
+            function = &currentFunction;
+            canonicalPathCount = 0;
+            expandedPathCount = 0;
+            pathSink = nullptr;
+            modelBuilt = false;
+            budgetHits = 0;
+            modelBudgetHits = 0;
+            emittedPaths = 0;
+            deadline = chrono::steady_clock::time_point::max(); // Set by analyzeFunction
+            setOutput(nullptr, nullptr);
+        }
+        FunctionAnalysis(const FunctionAnalysis &) = delete;
+        FunctionAnalysis &operator=(const FunctionAnalysis &) = delete;
 
-        for (auto it = adjListForDDG.begin(); it != adjListForDDG.end(); it++)
+        // Diagnostics and printed paths of this function.
+        raw_ostream &log()
+        {
+            return *logStream;
+        }
+        // Records of -rpe-path-sink=file.
+        raw_ostream &paths()
+        {
+            return *pathStream;
+        }
+        // Null streams send the output to the buffers.
+        void setOutput(raw_ostream *log, raw_ostream *paths)
         {
-            string source = it->first;
-            vector<pair<string, string>> adjList = it->second;
+            logStream = log ? log : &bufferedLog;
+            pathStream = paths ? paths : &bufferedPaths;
+        }
 
-            for (pair<string, string> elem : adjList)
-            {
-                output << source << "," << typeMap[source] << "," << elem.first << "," << typeMap[elem.first] << "," << elem.second << "\n";
-            }
+        // Running out of paths or time stops the enumeration of the function.
+        bool isOutOfBudget() const
+        {
+            return (budgetHits & (PathBudget | TimeBudget)) != 0;
         }
-        output.close();
-    }
 
-    static void addEdgeDDG(string source, string dest, string label)
-    {
-        if (source == "<badref>" || dest == "<badref>")
+        // Moves what the log buffered so far into modelLog, to be replayed every time paths are emitted.
+        void keepModelLog()
         {
-            errs() << "Badref found. Exiting without adding the edges.\n";
-            return;
+            bufferedLog.flush();
+            modelLog.swap(logBuffer);
+            logBuffer.clear();
         }
-        if (adjListForDDG.find(source) != adjListForDDG.end())
+
+        // What was buffered so far.
+        StringRef getBufferedLog()
         {
-            adjListForDDG[source].push_back(make_pair(dest, label));
+            return bufferedLog.str();
         }
-        else
+        StringRef getBufferedPaths()
+        {
+            return bufferedPaths.str();
+        }
+
+        // Writes out whatever was buffered. Only called on one thread, in module order.
+        void flush(raw_ostream &log, raw_ostream *paths)
         {
-            vector<pair<string, string>> children;
-            children.push_back(make_pair(dest, label));
-            adjListForDDG[source] = children;
+            log << bufferedLog.str();
+            if (paths)
+            {
+                *paths << bufferedPaths.str();
+            }
+            logBuffer.clear();
+            pathBuffer.clear();
         }
+    };
+
+    static void addEdgeDDG(FunctionAnalysis &analysis, VALUE_ID source, VALUE_ID dest, DDGLabel label, unsigned detail = 0)
+    {
+        const ValueTable &values = analysis.ddg.getValues();
+        if (values.isDetached(source) || values.isDetached(dest))
+        {
+            if (isLogging(LogSummary))
+            {
+                analysis.log() << "Badref found. Exiting without adding the edges.\n";
+            }
+            return;
+        }
+        analysis.ddg.addEdge(source, dest, label, detail);
     }
 
-    static void parseInstructionForDDG(Instruction &inst)
+    static void parseInstructionForDDG(FunctionAnalysis &analysis, Instruction &inst)
     {
+        ValueDependenceGraph &ddg = analysis.ddg;
         if (isa<AllocaInst>(inst))
         {
-            string allocationLocation = getLeftHandSide(&inst);
             AllocaInst *allocInst = dyn_cast<AllocaInst>(&inst);
-            string typeInfo = getTypeFromAddress(allocInst->getAllocatedType());
-            typeMap[allocationLocation] = typeInfo;
+            ddg.addValue(allocInst, allocInst->getAllocatedType());
         }
         else if (isa<StoreInst>(inst))
         {
             StoreInst *storeInst = dyn_cast<StoreInst>(&inst);
-
-            Value *storingElement = storeInst->getOperand(0);
-            string storingElementName = getStringRepresentationOfValue(storingElement);
-            string storingElementType = getTypeFromAddress(storingElement->getType());
-            typeMap[storingElementName] = storingElementType;
-
-            Value *storeLocation = storeInst->getPointerOperand();
-            string storeLocationName = getStringRepresentationOfValue(storeLocation);
-            string storeLocationType = getTypeFromAddress(storeLocation->getType());
-            typeMap[storeLocationName] = storeLocationType;
-
-            addEdgeDDG(storingElementName, storeLocationName, "store");
-
-            // errs()<<"Found Store Instruction.\n";
-            // errs()<<"Is return is :"<<storeInst->willReturn()<<"\n";
-            // errs()<<"Operand 0: "<<getStringRepresentationOfValue(storingElement)<<" Type: "<<storingElementType<<"\n";
-            // errs()<<"Operand 1: "<<getStringRepresentationOfValue(storeLocation)<<" Type: "<<storeLocationType<<"\n";
+            VALUE_ID storingElement = ddg.addValue(storeInst->getOperand(0));
+            VALUE_ID storeLocation = ddg.addValue(storeInst->getPointerOperand());
+            addEdgeDDG(analysis, storingElement, storeLocation, StoreEdge);
         }
         else if (isa<LoadInst>(inst))
         {
             LoadInst *loadInst = dyn_cast<LoadInst>(&inst);
-
-            Value *loadingTo = dyn_cast<Value>(&inst);
-            string loadingToName = getStringRepresentationOfValue(loadingTo);
-            string loadingToType = getTypeFromAddress(loadingTo->getType());
-            typeMap[loadingToName] = loadingToType;
-
-            Value *loadingFrom = loadInst->getPointerOperand();
-            string loadingFromName = getStringRepresentationOfValue(loadingFrom);
-            string loadingFromType = getTypeFromAddress(loadingFrom->getType());
-            typeMap[loadingFromName] = loadingFromType;
-
-            addEdgeDDG(loadingFromName, loadingToName, "load");
-
-            // errs()<<"Found load instruction\n";
-            // errs()<<"Will return is: "<<loadInst->willReturn()<<"\n";
-            // errs()<<"Loading to: "<<loadingToName<<" of Type: "<<loadingToType<<" ";
-            // errs()<<"From "<<loadingFromName<<" of Type: "<<loadingFromType<<"\n";
+            VALUE_ID loadingTo = ddg.addValue(loadInst);
+            VALUE_ID loadingFrom = ddg.addValue(loadInst->getPointerOperand());
+            addEdgeDDG(analysis, loadingFrom, loadingTo, LoadEdge);
         }
-        else if (isa<CallInst>(inst))
+        else if (isa<CallBase>(inst))
         {
-            CallInst *callInst = dyn_cast<CallInst>(&inst);
+            CallBase *callInst = dyn_cast<CallBase>(&inst);
             if (callInst->isInlineAsm())
             {
                 // We still need the return address and the operand List
@@ -127,51 +380,23 @@ namespace
                 // This is the usual case
                 // We need the function name, function's return value
                 // And operand list
-                string functionName = callInst->getCalledFunction()->getName().str();
-
-                Value *returnPoint = dyn_cast<Value>(&inst);
-                string returnPointName = getStringRepresentationOfValue(returnPoint);
-                string returnPointType = getTypeFromAddress(returnPoint->getType());
-                typeMap[returnPointName] = returnPointType;
-
-                // errs() << "Function " << functionName << " will return to " << returnPointName << " with type " << returnPointType << "\n";
-
-                int numOperands = callInst->getNumOperands();
-                for (int i = 0; i < numOperands - 1; i++)
+                VALUE_ID callee = ddg.addValue(callInst->getCalledOperand());
+                VALUE_ID returnPoint = ddg.addValue(callInst);
+                for (unsigned i = 0; i < callInst->arg_size(); i++)
                 {
-                    Value *argument = callInst->getArgOperand(i);
-                    string argumentName = getStringRepresentationOfValue(argument);
-                    string argumentType = getTypeFromAddress(argument->getType());
-                    typeMap[argumentName] = argumentType;
-                    string label = "call:";
-                    label = label.append(functionName);
-                    addEdgeDDG(argumentName, returnPointName, label);
-                    // errs() << "Argument Number: " << i << " Value: " << argumentName << " Type: " << argumentType << "\n";
+                    VALUE_ID argument = ddg.addValue(callInst->getArgOperand(i));
+                    addEdgeDDG(analysis, argument, returnPoint, CallEdge, callee);
                 }
-                // errs() << "\n";
             }
         }
         else if (isa<GetElementPtrInst>(inst))
         {
-            Value *argument = dyn_cast<Value>(&inst);
-            string returnPointName = getStringRepresentationOfValue(argument);
-            string returnPointType = getTypeFromAddress(argument->getType());
-            typeMap[returnPointName] = returnPointType;
-
-            // errs() << "GetelementPointer will return to " << returnPointName << " with type " << returnPointType << "\n";
-
             GetElementPtrInst *gepInst = dyn_cast<GetElementPtrInst>(&inst);
-            int numOperands = gepInst->getNumOperands();
-            for (int i = 0; i < numOperands; i++)
+            VALUE_ID returnPoint = ddg.addValue(gepInst);
+            for (Value *operand : gepInst->operands())
             {
-                Value *operand = gepInst->getOperand(i);
-                string operandName = getStringRepresentationOfValue(operand);
-                string operandType = getTypeFromAddress(operand->getType());
-                typeMap[operandName] = operandType;
-                addEdgeDDG(operandName, returnPointName, "getelementptr");
-                // errs() << "Operand " << i << " Operand Name: " << operandName << " Operand Type: " << operandType << "\n";
+                addEdgeDDG(analysis, ddg.addValue(operand), returnPoint, GetElementPtrEdge);
             }
-            // errs() << "\n";
         }
         else if (isa<ReturnInst>(inst))
         {
@@ -179,685 +404,1285 @@ namespace
         }
         else if (isa<TruncInst>(&inst))
         {
-            Value *val = dyn_cast<Value>(&inst);
-            string returnPointName = getStringRepresentationOfValue(val);
-            string returnPointType = getTypeFromAddress(val->getType());
-            typeMap[returnPointName] = returnPointType;
-            // errs() << "Truncation will return to " << returnPointName << " with type " << returnPointType << "\n";
-
-            Value *argument = inst.getOperand(0);
-            string truncationArgument = getStringRepresentationOfValue(argument);
-            string truncationArgumentType = getTypeFromAddress(argument->getType());
-            typeMap[truncationArgument] = truncationArgumentType;
-
-            addEdgeDDG(truncationArgument, returnPointName, "truncate");
-
-            // errs() << "Operand Name: " << truncationArgument << " Operand Type: " << truncationArgumentType << "\n\n";
+            VALUE_ID returnPoint = ddg.addValue(&inst);
+            VALUE_ID truncationArgument = ddg.addValue(inst.getOperand(0));
+            addEdgeDDG(analysis, truncationArgument, returnPoint, TruncateEdge);
         }
         else if (isa<BranchInst>(&inst))
         {
             // [TODO: BranchInstuction is about control flow transfer. We do not need that for DDG.]
         }
         else if(isa<ICmpInst>(&inst)){
-            Value *val = dyn_cast<Value>(&inst);
-            string comparisonResult = getStringRepresentationOfValue(val);
-            string comparisonResultType = getTypeFromAddress(val->getType());
-            typeMap[comparisonResult] = comparisonResultType;
-
-            Value *operand0 = inst.getOperand(0);
-            Value *operand1 = inst.getOperand(1);
-
-            string firstOperandName = getStringRepresentationOfValue(operand0);
-            string firstOperandType = getTypeFromAddress(operand0->getType());
-            typeMap[firstOperandName] = firstOperandType;
-
-            string secondOperandName = getStringRepresentationOfValue(operand1);
-            string seconndOperandType = getTypeFromAddress(operand1->getType());
-            typeMap[secondOperandName] = seconndOperandType;
-
             ICmpInst *icmpInst = dyn_cast<ICmpInst>(&inst);
-            string predicateName = icmpInst->getPredicateName(icmpInst->getPredicate()).str();
+            VALUE_ID comparisonResult = ddg.addValue(icmpInst);
+            VALUE_ID firstOperand = ddg.addValue(inst.getOperand(0));
+            VALUE_ID secondOperand = ddg.addValue(inst.getOperand(1));
 
-            addEdgeDDG(firstOperandName, comparisonResult, "icmp:0 "+predicateName);
-            addEdgeDDG(secondOperandName, comparisonResult, "icmp:1 "+predicateName);
+            unsigned predicate = icmpInst->getPredicate();
+            addEdgeDDG(analysis, firstOperand, comparisonResult, ICmpEdge, predicate);
+            addEdgeDDG(analysis, secondOperand, comparisonResult, ICmpEdge, (1u << 16) | predicate);
         }
         else
         {
             // [TODO: Add more instruction type + Analyze which ones are needed for our use case.]
-            Value *val = dyn_cast<Value>(&inst);
-            string returnPointName = getStringRepresentationOfValue(val);
-            string returnPointType = getTypeFromAddress(val->getType());
-            typeMap[returnPointName] = returnPointType;
-
-            // errs()<<"Instruction Name: "<<getTypeFromAddress(inst.getType()) <<" Return Point :"<<returnPointName<<" Return Type: "<<returnPointType<<"\n";
-
-            int numOperands = inst.getNumOperands();
-            for (int i = 0; i < numOperands; i++)
+            VALUE_ID returnPoint = ddg.addValue(&inst);
+            for (Value *operand : inst.operands())
             {
-                Value *operand = inst.getOperand(i);
-                string operandName = getStringRepresentationOfValue(operand);
-                string operandType = getTypeFromAddress(operand->getType());
-                typeMap[operandName] = operandType;
-
-                addEdgeDDG(operandName, returnPointName, inst.getOpcodeName() );
+                addEdgeDDG(analysis, ddg.addValue(operand), returnPoint, OpcodeEdge, inst.getOpcode());
             }
-            // errs()<<"\n";
         }
     }
 
-    static void loadRelevantFunction()
+    // Read once per process, on first use. A spec that cannot be read leaves the default catalog.
+    static const RelevantFunctionCatalog &getRelevantFunctionCatalog()
     {
-        relevantFunctions["open"] = make_pair("FILE", -1);
-        relevantFunctions["read"] = make_pair("FILE", 0);
-        relevantFunctions["write"] = make_pair("FILE", 0);
-        relevantFunctions["close"] = make_pair("FILE", 0);
-        relevantFunctions["fopen"] = make_pair("FILE", -1);
-        relevantFunctions["fread"] = make_pair("FILE", 0);
-        relevantFunctions["fwrite"] = make_pair("FILE", 0);
-        relevantFunctions["fclose"] = make_pair("FILE", 0);
+        static unique_ptr<RelevantFunctionCatalog> catalog = []()
+        {
+            unique_ptr<RelevantFunctionCatalog> loaded(new RelevantFunctionCatalog());
+            string error;
+            if (!CatalogFileName.empty() && !loaded->load(CatalogFileName, error))
+            {
+                errs() << "ERROR: Could not read " << CatalogFileName << ": " << error << ". Using the default catalog.\n";
+            }
+            else if (!CatalogFileName.empty())
+            {
+                return loaded;
+            }
+            error.clear();
+            loaded->parse(DEFAULT_CATALOG, error);
+            return loaded;
+        }();
+        return *catalog;
     }
 
-    static void parseCallInstruction(CallInst *call, Instruction *inst, AugmentedBasicBlock *currBlock)
+    // Adds the call to the last block of the analysis' augmented CFG.
+    static void parseCallInstruction(FunctionAnalysis &analysis, CallBase *call, Instruction *inst)
     {
+        AugmentedCFG &acfg = analysis.acfgNodes;
         if (call->isInlineAsm())
         {
-            parseInlineAssemblyString(getInstructionString(inst), call);
-            currBlock->setInlineAssembly();
-            currBlock->addInstruction(inst);
+            acfg.addInlineAssembly(call);
+            acfg.addInstruction(inst);
         }
         else
         {
-
-            currBlock->addInstruction(inst);
+            acfg.addInstruction(inst);
             Function *function = call->getCalledFunction();
             if (function != NULL)
             {
-                currBlock->addFunction(function->getName());
-                int numOperands = call->getNumOperands();
-                for (int i = 0; i < numOperands - 1; i++)
-                {
-                    Value *operand = call->getArgOperand(i);
-                }
+                acfg.addFunction(function->getName());
             }
             else
             {
-                errs() << "ERROR: function from call instruction is null. Might be a function pointer.\n";
+                analysis.log() << "ERROR: function from call instruction is null. Might be a function pointer.\n";
             }
         }
     }
 
-    static void parseBinaryBranchInstruction(BranchInst *brInst, AugmentedBasicBlock *acfgNode)
+    // Successors of any terminator, with the kind of each edge. CompactCFG lists them in the
+    // terminator's own order, so the index of a successor is its index in the terminator.
+    static void parseTerminator(const CompactCFG &cfg, BLOCK_ID blockId, AugmentedCFG &acfg)
     {
-        if (brInst->isConditional())
+        const Instruction *terminator = cfg.getBlock(blockId)->getTerminator();
+        ArrayRef<BLOCK_ID> children = cfg.getSuccessors(blockId);
+        if (children.size() > 1)
         {
-            acfgNode->setConditionalBlock();
-            Value *op1 = brInst->getSuccessor(0);
-            acfgNode->setTrueBlock(getSimpleNodeLabel(dyn_cast<BasicBlock>(op1)));
-            Value *op2 = brInst->getSuccessor(1);
-            acfgNode->setFalseBlock(getSimpleNodeLabel(dyn_cast<BasicBlock>(op2)));
+            acfg.setFlag(ConditionalBlock);
         }
-        else if (brInst->isUnconditional())
+        for (unsigned i = 0; i < children.size(); i++)
         {
-            Value *op = brInst->getSuccessor(0);
-            acfgNode->setNextBlock(getSimpleNodeLabel(dyn_cast<BasicBlock>(op)));
+            acfg.addSuccessor(children[i], getSuccessorKind(terminator, i));
         }
     }
 
-    static void parseSwitchInstruction(SwitchInst *switch_inst)
+    // Edges along which a value keeps referring to the same object.
+    static bool isLoadStoreEdge(const ValueDependence &edge)
     {
-        // [TODO]
+        return edge.label == StoreEdge || edge.label == LoadEdge || edge.label == TruncateEdge;
     }
 
-    static bool loopDfsUtil(GRAPH adjList, string node)
+    static void printProvenanceEdges(FunctionAnalysis &analysis)
     {
-        // errs()<<"Called with node: "<<node<<"\n";
-        visited[node] = GRAY;
-        vector<string> children = adjList[node];
-        bool res = false;
-        for (string child : children)
+        const vector<PROVENANCE_ID> &adjList = analysis.provenanceAdjList["process_name"];
+        for (PROVENANCE_ID node : adjList)
         {
-            if (visited[child] == GRAY)
-            {
-                // errs()<<"Loop detected\n";
-                loopingBlocks.push_back(child);
-                backEdges[node] = make_pair(node, child); // The looping block is the key. The backedge is the value.
-                res = true;
-            }
-            if (visited[child] == WHITE && loopDfsUtil(adjList, child))
-            {
-                res = true;
-            }
+            const ProvenanceNode &provenanceNode = analysis.provenanceNodes.getNode(node);
+            analysis.log() << provenanceNode.action << " " << provenanceNode.artifact << " " << provenanceNode.id << "\n";
         }
-        visited[node] = BLACK;
-        return res;
     }
 
-    static pair<bool, vector<string>> containsLoop(GRAPH adjList, string root)
+    // Name of the object a provenance node refers to, printed like getStringRepresentationOfValue.
+    static string getObjectName(FunctionAnalysis &analysis, const Value *value)
     {
-
-        loopingBlocks.clear();
-        visited.clear();
-
-        bool hasLoop = false;
-        for (auto key : adjList)
+        const ValueTable &values = analysis.ddg.getValues();
+        VALUE_ID valueId = 0;
+        if (values.findValueId(value, valueId))
         {
-            visited[key.first] = WHITE;
+            return values.getName(valueId);
         }
-
-        hasLoop = loopDfsUtil(adjList, root);
-
-        return make_pair(hasLoop, loopingBlocks);
+        return getStringRepresentationOfValue(const_cast<Value *>(value));
     }
 
-    static void monolithicTraverse(GRAPH adjList, string node, list<string> currentPath)
+    static void printInlineAssembly(FunctionAnalysis &analysis)
     {
-        currentPath.push_back(node);
-        vector<string> children = adjList[node];
-        if (children.empty())
+        static const char *const OPERAND_KINDS[] = {"output", "input", "clobber"};
+        const AugmentedCFG &acfg = analysis.acfgNodes;
+        for (BLOCK_ID block = 0; block < acfg.size(); block++)
         {
-            // This is a leaf node.
-            canonicalPaths.push_back(currentPath);
-        }
-        else
-        {
-            for (string child : children)
+            for (const InlineAssembly &assembly : acfg.getInlineAssembly(block))
             {
-                list<string> currPathClone(currentPath);
-                monolithicTraverse(adjList, child, currPathClone);
+                analysis.log() << "Inline assembly in " << analysis.cfg.getLabel(block) << ": \"" << assembly.asmString << "\"\n";
+                for (const InlineAsmOperand &operand : acfg.getOperands(assembly))
+                {
+                    analysis.log() << "  " << OPERAND_KINDS[operand.kind] << " " << operand.constraint;
+                    if (operand.value != nullptr)
+                    {
+                        analysis.log() << " " << getObjectName(analysis, operand.value);
+                    }
+                    analysis.log() << "\n";
+                }
             }
         }
     }
 
-    static void loopAwareTraverse(GRAPH adjList, map<string, AugmentedBasicBlock> acfgNodes, string node, list<string> currentPath)
+    /**
+     * Provenance edges of a single canonical path. Called with each path as it is found.
+     * Each call starts a new graph, so the nodes of the previous path are dropped. Their
+     * strings stay interned for the rest of the function.
+     */
+    static void generateProvenanceEdges(FunctionAnalysis &analysis, PATH_ID pathId, const PATH &path)
     {
-        // Check if it is a looping node and have been called already
-        if (find(loopingBlocks.begin(), loopingBlocks.end(), node) != loopingBlocks.end())
+        PhaseTimer timer("provenance", "Provenance generation", analysis.function->getName(), true);
+        const AugmentedCFG &acfgNodes = analysis.acfgNodes;
+        ProvenanceStore &provenanceNodes = analysis.provenanceNodes;
+        provenanceNodes.clearNodes();
+        analysis.provenanceAdjList.clear();
+        vector<PROVENANCE_ID> &edges = analysis.provenanceAdjList["process_name"];
+        edges.push_back(provenanceNodes.addNode("load", "FILE", "process_name_start"));
+
+        // Get each block id and access the function vector from the acfgNodes
+        for (BLOCK_ID node : path)
         {
-            if (find(loopAwareVisited.begin(), loopAwareVisited.end(), node) != loopAwareVisited.end())
+            if (node != LOOP_START_MARKER && node != LOOP_END_MARKER)
             {
-                return;
+                // errs() << "Functions in Block : " << node << "\n";
+                for (Instruction *inst : acfgNodes.getInstructions(node))
+                {
+                    CallBase *call = dyn_cast<CallBase>(inst);
+                    Function *callee = call->getCalledFunction();
+                    if (callee == nullptr)
+                    {
+                        // Inline assembly and calls through pointers.
+                        continue;
+                    }
+                    const RelevantFunctionSpec *spec = relevantFunctions.find(callee);
+                    const ProvenanceSummary *summary = nullptr;
+                    if (spec != nullptr)
+                    {
+                        if (spec->object == RETURNED_OBJECT)
+                        {
+                            Value *val = dyn_cast<Value>(inst);
+                            string id = getObjectName(analysis, val);
+                            edges.push_back(provenanceNodes.addNode(spec->action, spec->artifact, id, val));
+                        }
+                        else if ((unsigned)spec->object < call->arg_size())
+                        {
+                            Value *val = call->getArgOperand(spec->object);
+                            string id = getObjectName(analysis, val);
+                            edges.push_back(provenanceNodes.addNode(spec->action, spec->artifact, id, val));
+                        }
+                    }
+                    else if ((summary = provenanceSummaries.getSummary(callee)) != nullptr)
+                    {
+                        // The callee was summarized before any function was analyzed, so its body is not walked again.
+                        for (const ProvenanceEffect &effect : summary->effects)
+                        {
+                            const Value *object = nullptr;
+                            string id = effect.localId.str();
+                            if (effect.kind == ArgumentObject && effect.argument < call->arg_size())
+                            {
+                                object = call->getArgOperand(effect.argument);
+                            }
+                            else if (effect.kind == ReturnedObject)
+                            {
+                                object = call;
+                            }
+                            if (object)
+                            {
+                                id = getObjectName(analysis, object);
+                            }
+                            edges.push_back(provenanceNodes.addNode(effect.action, effect.artifact, id, object));
+                        }
+                    }
+                    else if (isLogging(LogStructure))
+                    {
+                        analysis.log() << "Function " << callee->getName() << " Is not relevant.\n";
+                    }
+                }
             }
         }
+        edges.push_back(provenanceNodes.addNode("exit", "PROCESS", "process_name_exit"));
+        NumProvenanceNodes += edges.size();
+        if (isLogging(LogPaths))
+        {
+            printProvenanceEdges(analysis);
+        }
 
-        currentPath.push_back(node);
-        AugmentedBasicBlock acfgNode = acfgNodes[node];
-        if (!loopingBlocks.empty() && find(loopingBlocks.begin(), loopingBlocks.end(), node) != loopingBlocks.end())
+        // Nodes whose values are connected through stores, loads and truncations refer to the same
+        // object, which is named after the first of them on the path.
+        if (!analysis.loadStoreAliases.isBuilt())
+        {
+            analysis.loadStoreAliases.build(analysis.ddg, isLoadStoreEdge);
+        }
+        const ValueTable &values = analysis.ddg.getValues();
+        DenseMap<unsigned, StringRef> uniqueObjects; // Alias class -> id of the object
+        for (PROVENANCE_ID node : edges)
         {
-            if (acfgNode.getConditionalBlock())
+            ProvenanceNode &elem = provenanceNodes.getNode(node);
+            VALUE_ID valueId = 0;
+            if (elem.object == nullptr || !values.findValueId(elem.object, valueId))
             {
-                // Loop and Conditional. So either For loop or While Loop.
-                string falseNode = acfgNode.getFalseBlock();
-                list<string> clonedCurrentPath(currentPath);
-                loopAwareVisited.insert(node);
-                loopAwareTraverse(adjList, acfgNodes, falseNode, clonedCurrentPath);
+                continue;
             }
-            else
+            ++NumAliasClassLookups;
+            auto inserted = uniqueObjects.insert(make_pair(analysis.loadStoreAliases.getClass(valueId), elem.id));
+            if (!inserted.second)
             {
-                // Loop and Unconditional. So do-while loop.
-                string nextNode = acfgNode.getNextBlock();
-                loopAwareVisited.insert(node);
-                list<string> clonedCurrentPath(currentPath);
-                loopAwareTraverse(adjList, acfgNodes, nextNode, clonedCurrentPath);
+                elem.id = inserted.first->second;
             }
         }
-        else
+
+        if (isLogging(LogPaths))
         {
-            // Not a conditional block. Straight to next children block
-            vector<string> children = adjList[node];
-            loopAwareVisited.insert(node);
-            if (children.empty())
+            printProvenanceEdges(analysis);
+        }
+        if (analysis.modelEncoder)
+        {
+            ModelEncoder &model = *analysis.modelEncoder;
+            model.addChain(pathId);
+            for (PROVENANCE_ID node : edges)
             {
-                // Reached a leaf node. This is a complete path.
-                canonicalPaths.push_back(currentPath);
+                const ProvenanceNode &elem = provenanceNodes.getNode(node);
+                model.addProvenanceNode(elem.action, elem.artifact, elem.id);
             }
-            else
+        }
+    }
+
+    static CSRGraph extractDirectedAdjList(const CSRGraph &adjList, const LoopForest &loops)
+    {
+        CSRGraph directedAcgf;
+        directedAcgf.reserve(adjList.getNumNodes(), adjList.getNumEdges());
+
+        for (BLOCK_ID node = 0; node < adjList.getNumNodes(); node++)
+        {
+            directedAcgf.addNode();
+            for (BLOCK_ID child : adjList.getChildren(node))
             {
-                for (string child : children)
+                // Every copy of a back edge goes, so a switch with several cases to the header leaves no cycle.
+                if (!loops.isBackEdge(node, child))
                 {
-                    // Clone the existing path and pass it along for the next layer.
-                    list<string> currentPathClone(currentPath);
-                    loopAwareTraverse(adjList, acfgNodes, child, currentPathClone);
+                    directedAcgf.addEdge(child);
                 }
             }
         }
+        return directedAcgf;
     }
 
-    static bool checkLoadStoreSequenceBetweenNodesinDDG(string source, string dest)
+    // Records that the function ran out of budget, counting each budget once per function.
+    static void exhaustBudget(FunctionAnalysis &analysis, AnalysisBudget budget)
     {
-        if (source == dest)
+        if (analysis.budgetHits & budget)
         {
-            return true;
+            return;
+        }
+        analysis.budgetHits |= budget;
+        switch (budget)
+        {
+        case ThresholdBudget:
+            ++NumThresholdHits;
+            break;
+        case PathBudget:
+            ++NumPathBudgetHits;
+            break;
+        case LengthBudget:
+            ++NumLengthBudgetHits;
+            break;
+        case DepthBudget:
+            ++NumDepthBudgetHits;
+            break;
+        default:
+            ++NumTimeBudgetHits;
+            break;
+        }
+    }
+
+    // Whether the function ran out of -rpe-time-budget.
+    static bool isPastDeadline(FunctionAnalysis &analysis)
+    {
+        if (FunctionTimeBudget != 0 && chrono::steady_clock::now() >= analysis.deadline)
+        {
+            exhaustBudget(analysis, TimeBudget);
+        }
+        return (analysis.budgetHits & TimeBudget) != 0;
+    }
+
+    // Whether one more path may be emitted, charging it to the function's path and time budgets.
+    static bool spendPath(FunctionAnalysis &analysis)
+    {
+        if (analysis.isOutOfBudget())
+        {
+            return false;
+        }
+        if (MaxFunctionPaths != 0 && analysis.emittedPaths >= MaxFunctionPaths)
+        {
+            exhaustBudget(analysis, PathBudget);
+            return false;
         }
-        if (adjListForDDG.find(source) == adjListForDDG.end())
+        if (isPastDeadline(analysis))
         {
             return false;
         }
+        analysis.emittedPaths++;
+        return true;
+    }
 
-        vector<pair<string, string>> adjList = adjListForDDG[source];
-        bool ret = false;
-        for (pair<string, string> element : adjList)
+    // Names of the budgets in hits, separated by spaces.
+    static string getBudgetNames(unsigned hits)
+    {
+        string names;
+        for (unsigned budget = 0; budget < NUM_BUDGETS; budget++)
         {
-            if (element.second == "store" || element.second == "load" || element.second == "truncate")
+            if (hits & (1u << budget))
             {
-                ret |= checkLoadStoreSequenceBetweenNodesinDDG(element.first, dest);
+                names += names.empty() ? "" : " ";
+                names += BUDGET_NAMES[budget];
             }
         }
-        return ret;
+        return names;
     }
 
-    static void printProvenanceEdges()
+    /**
+     * A looping block expands into one sub-path per expanded path of its loop body (see expandPath).
+     * The body paths run from the header to a latch and the header itself is not repeated, so
+     * the back edge of a self loop has no body path. A header whose only latch is itself has a
+     * weight of zero: every path through it counts as no expanded path, just as expandPath
+     * emits none for it. Non looping blocks have a weight of one.
+     */
+    static PATH_COUNT getExpansionWeight(FunctionAnalysis &analysis, const CSRGraph &dagGraph, BLOCK_ID node)
     {
-        vector<ProvenanceNode *> adjList = provenanceAdjList["process_name"];
-        for (ProvenanceNode *node : adjList)
+        if (node == LOOP_START_MARKER || node == LOOP_END_MARKER || !analysis.loops.isHeader(node))
+        {
+            return 1;
+        }
+        auto memo = analysis.expansionWeights.find(node);
+        if (memo != analysis.expansionWeights.end())
         {
-            errs() << node->action << " " << node->artifact << " " << node->id << "\n";
+            return memo->second;
         }
+
+        analysis.expansionWeights[node] = 1; // Guards against irreducible loops that reach each other's headers.
+        PATH_COUNT total = 0;
+        vector<PATH_COUNT> numPaths;
+        for (BLOCK_ID latch : analysis.loops.getLatches(analysis.loops.getHeadedLoop(node)))
+        {
+            if (latch == node)
+            {
+                continue;
+            }
+            PATH_COUNT bodyPaths = countPaths(dagGraph, node, latch, numPaths, [&analysis, &dagGraph](BLOCK_ID child)
+                                              { return getExpansionWeight(analysis, dagGraph, child); });
+            total = SaturatingAdd(total, bodyPaths);
+        }
+        analysis.expansionWeights[node] = total;
+        return total;
     }
 
-    static void dumpProvenanceEdges(string fileName)
+    static PATH_COUNT countExpandedPaths(FunctionAnalysis &analysis, const CSRGraph &dagGraph, const PATH &p)
     {
-        error_code ec;
-        raw_fd_ostream output(fileName, ec);
-
-        vector<ProvenanceNode *> adjList = provenanceAdjList["process_name"];
-        for (ProvenanceNode *elem : adjList)
+        PATH_COUNT count = 1;
+        for (BLOCK_ID node : p)
         {
-            output << elem->action << "," << elem->artifact << "," << elem->id << "\n";
+            count = SaturatingMultiply(count, getExpansionWeight(analysis, dagGraph, node));
         }
-        output.close();
+        return count;
     }
 
-    static void generateProvenanceEdges(map<string, AugmentedBasicBlock> acfgNodes)
+    static void countFunctionPaths(FunctionAnalysis &analysis, const CompactCFG &cfg, const CSRGraph &dagGraph)
     {
-        loadRelevantFunction();
-        vector<ProvenanceNode *> edges;
-        ProvenanceNode start("load", "FILE", "process_name_start");
-        edges.push_back(&start);
-        provenanceAdjList["process_name"] = edges;
-        int count = 0;
-        for (PATH path : canonicalPaths)
+        BLOCK_ID rootId = cfg.getRoot();
+        vector<PATH_COUNT> numPaths;
+
+        analysis.loopingPathCounts.clear();
+        analysis.expansionWeights.clear();
+        for (EDGE edge : analysis.loops.getBackEdges())
+        {
+            PATH_COUNT bodyPaths = countPaths(dagGraph, edge.second, edge.first, numPaths);
+            analysis.loopingPathCounts[edge.second] = SaturatingAdd(analysis.loopingPathCounts[edge.second], bodyPaths);
+        }
+
+        analysis.canonicalNumbering.build(dagGraph, rootId);
+        analysis.canonicalPathCount = analysis.canonicalNumbering.getNumPaths();
+        analysis.expandedPathCount = countPaths(dagGraph, rootId, ANY_SINK, numPaths, [&analysis, &dagGraph](BLOCK_ID child)
+                                                { return getExpansionWeight(analysis, dagGraph, child); });
+        analysis.expandedPathCount = SaturatingMultiply(analysis.expandedPathCount, getExpansionWeight(analysis, dagGraph, rootId));
+
+        if (isLogging(LogSummary))
+        {
+            analysis.log() << "Function has " << formatPathCount(analysis.canonicalPathCount) << " acyclic paths and "
+                           << formatPathCount(analysis.expandedPathCount) << " paths after loop expansion.\n";
+        }
+        if (isLogging(LogStructure))
         {
-            errs() << "Path Number : " << ++count << "\n\n";
-            // Get each block id and access the function vector from the acfgNodesMap
-            for (string node : path)
+            for (auto &elem : analysis.loopingPathCounts)
             {
-                if (node != "START" && node != "END")
-                {
-                    // errs() << "Functions in Block : " << node << "\n";
-                    AugmentedBasicBlock abb = acfgNodes[node];
-                    vector<Instruction *> instructionsInBlock = abb.getInstructions();
-                    for (Instruction *inst : instructionsInBlock)
-                    {
-                        CallInst *call = dyn_cast<CallInst>(inst);
-                        string funcName = call->getCalledFunction()->getName().str();
-                        if (relevantFunctions.find(funcName) != relevantFunctions.end())
-                        {
+                analysis.log() << "Loop anchored at " << cfg.getLabel(elem.first) << " has " << formatPathCount(elem.second) << " acyclic paths.\n";
+            }
+        }
+    }
 
-                            pair<string, int> relevantInfo = relevantFunctions[funcName];
-                            if (relevantInfo.second == -1)
-                            {
-                                Value *val = dyn_cast<Value>(inst);
-                                string id = getStringRepresentationOfValue(val);
-                                ProvenanceNode *node1 = new ProvenanceNode(funcName, relevantInfo.first, id);
-                                provenanceAdjList["process_name"].push_back(node1);
-                            }
-                            else
-                            {
-                                Value *val = call->getArgOperand(relevantInfo.second);
-                                string id = getStringRepresentationOfValue(val);
-                                ProvenanceNode *node1 = new ProvenanceNode(funcName, relevantInfo.first, id);
-                                provenanceAdjList["process_name"].push_back(node1);
-                            }
-                        }
-                        else
-                        {
-                            errs() << "Function " << funcName << " Is not relevant.\n";
-                        }
-                    }
+    static void extractLoopingPaths(FunctionAnalysis &analysis, const CSRGraph &dagGraph, const CompactCFG &cfg){
+        analysis.loopingPaths.clear();
+        for(EDGE edge: analysis.loops.getBackEdges()){
+            if (analysis.loopingPathCounts[edge.second] > PathEnumerationThreshold)
+            {
+                exhaustBudget(analysis, ThresholdBudget);
+                if (isLogging(LogSummary))
+                {
+                    analysis.log() << "Loop anchored at " << cfg.getLabel(edge.second) << " is above the enumeration threshold. Skipping it.\n";
                 }
+                continue;
             }
-            ProvenanceNode *exitNode = new ProvenanceNode("exit", "PROCESS", "process_name_exit");
-            provenanceAdjList["process_name"].push_back(exitNode);
-            printProvenanceEdges();
-            set<string> uniqueObjects;
-            uniqueObjects.insert("process_name");
-            vector<ProvenanceNode *> adjList = provenanceAdjList["process_name"];
-            for (ProvenanceNode *elem : adjList)
-            {
-                string currId = elem->id;
-                bool result = false;
-                for (string uObj : uniqueObjects)
-                {
-                    result |= checkLoadStoreSequenceBetweenNodesinDDG(uObj, currId);
-                    if (result)
-                    {
-                        elem->id = uObj;
-                        break;
-                    }
+            BallLarusNumbering numbering;
+            numbering.build(dagGraph, edge.second, edge.first);
+            analysis.loopingPaths[edge.second].push_back(numbering);
+        }
+        if (isLogging(LogPaths))
+        {
+            printLoopExecutionPaths(analysis.log(), analysis.loopingPaths, cfg);
+        }
+    }
+
+    /**
+     * Expands the loops of p[position..] after the blocks already in prefix, and calls onExpanded
+     * with prefix holding each complete expansion in turn. Every looping block is replaced by
+     * LOOP_START, the block, one expanded path through its loop body and LOOP_END, so a path with
+     * m choices at one loop and n at the next expands into m*n paths. Only the current expansion
+     * is held in memory. depth is the number of loops p is the body of, and reserved the number of
+     * blocks that follow p in the expansion. A loop deeper than -rpe-max-loop-depth, or all of whose
+     * bodies would make the path longer than -rpe-max-path-length, is left folded into its header.
+     */
+    static void expandPath(FunctionAnalysis &analysis, const PATH &p, unsigned position, PATH &prefix, unsigned depth, unsigned reserved,
+                           function_ref<void()> onExpanded){
+        if(analysis.isOutOfBudget()){
+            return;
+        }
+        if(position == p.size()){
+            onExpanded();
+            return;
+        }
+
+        BLOCK_ID n = p[position];
+        bool isLoopingBlock = n != LOOP_START_MARKER && n != LOOP_END_MARKER && analysis.loops.isHeader(n);
+        if(isLoopingBlock && MaxLoopExpansionDepth != 0 && depth >= MaxLoopExpansionDepth){
+            exhaustBudget(analysis, DepthBudget);
+            isLoopingBlock = false;
+        }
+        if(!isLoopingBlock){
+            prefix.push_back(n);
+            expandPath(analysis, p, position + 1, prefix, depth, reserved, onExpanded);
+            prefix.pop_back();
+            return;
+        }
+
+        prefix.push_back(LOOP_START_MARKER);
+        prefix.push_back(n);
+        unsigned following = p.size() - position - 1 + reserved; // Blocks after LOOP_END, at the least
+        bool expanded = false;
+        bool tooLong = false;
+        PATH loopBody;
+        for(const BallLarusNumbering &numbering: analysis.loopingPaths[n]){
+            // Bodies that are skipped as too long emit nothing, so the clock is read here as well.
+            for(PATH_ID id = 0; id < numbering.getNumPaths() && !analysis.isOutOfBudget(); id++){
+                if(id % DEADLINE_CHECK_INTERVAL == 0 && isPastDeadline(analysis)){
+                    break;
                 }
-                if (!result)
-                {
-                    uniqueObjects.insert(currId);
+                numbering.regeneratePath(id, loopBody);
+                loopBody.erase(loopBody.begin());
+                if(loopBody.empty()){
+                    continue;
                 }
+                if(MaxExpandedPathLength != 0 && prefix.size() + loopBody.size() + 1 + following > MaxExpandedPathLength){
+                    tooLong = true;
+                    continue;
+                }
+                expanded = true;
+                expandPath(analysis, loopBody, 0, prefix, depth + 1, following + 1, [&](){
+                    prefix.push_back(LOOP_END_MARKER);
+                    expandPath(analysis, p, position + 1, prefix, depth, reserved, onExpanded);
+                    prefix.pop_back();
+                });
+            }
+        }
+        prefix.pop_back();
+        prefix.pop_back();
+        if(tooLong){
+            exhaustBudget(analysis, LengthBudget);
+            if(!expanded){
+                prefix.push_back(n);
+                expandPath(analysis, p, position + 1, prefix, depth, reserved, onExpanded);
+                prefix.pop_back();
             }
+        }
+    }
 
-            printProvenanceEdges();
-            dumpProvenanceEdges("prov_edges.txt");
-            break; // This is temporary.
+    /**
+     * We take a Canonical Path here and Expand It Using the looping block paths.
+     * Each expanded path goes straight to the path sink.
+     * And then Instantiate it by naively executing the loops by sampling them.
+    */
+    static void generatePathsFromCanonicalPath(FunctionAnalysis &analysis, const PATH &p){
+        PhaseTimer timer("expansion", "Loop expansion", analysis.function->getName(), true);
+        PATH_COUNT expansions = countExpandedPaths(analysis, analysis.dagAdjList, p);
+        if(expansions > PathEnumerationThreshold){
+            exhaustBudget(analysis, ThresholdBudget);
+            if(isLogging(LogSummary)){
+                analysis.log()<<"Path expands into "<<formatPathCount(expansions)<<" paths, above the enumeration threshold. Skipping it.\n";
+            }
+            return;
+        }
+        PATH expandedPath;
+        expandPath(analysis, p, 0, expandedPath, 0, 0, [&analysis, &expandedPath](){
+            if(!spendPath(analysis)){
+                return;
+            }
+            ++NumExpandedPaths;
+            analysis.pathSink->consumeExpandedPath(expandedPath);
+        });
+    }
+
+    static void emitCanonicalPath(FunctionAnalysis &analysis, PATH_ID pathId){
+        if(!spendPath(analysis)){
+            return;
+        }
+        PATH path;
+        analysis.canonicalNumbering.regeneratePath(pathId, path);
+        ++NumCanonicalPaths;
+        analysis.pathSink->consumeCanonicalPath(pathId, path);
+        if (analysis.modelEncoder)
+        {
+            analysis.emittedPathIds.push_back(pathId);
+        }
+        generatePathsFromCanonicalPath(analysis, path);
+        if (GenerateProvenance)
+        {
+            generateProvenanceEdges(analysis, pathId, path);
+        }
+    }
+
+    /**
+     * The traversals below borrow the graph and the ABBs read-only. Instead of building
+     * the blocks of each path they accumulate the Ball-Larus increments of the edges taken,
+     * and a complete path is recorded by its id.
+     */
+    static void monolithicTraverse(FunctionAnalysis &analysis, const CSRGraph &dagGraph, BLOCK_ID node, PATH_ID pathId)
+    {
+        if (analysis.isOutOfBudget())
+        {
+            return;
+        }
+        ArrayRef<BLOCK_ID> children = dagGraph.getChildren(node);
+        if (children.empty())
+        {
+            // This is a leaf node.
+            emitCanonicalPath(analysis, pathId);
+        }
+        else
+        {
+            for (unsigned i = 0; i < children.size(); i++)
+            {
+                monolithicTraverse(analysis, dagGraph, children[i], pathId + analysis.canonicalNumbering.getIncrement(node, i));
+            }
         }
     }
 
-    static GRAPH buildAdjacencyList(vector<EDGE> eList, map<string, AugmentedBasicBlock> acfgNodes, bool debug = false)
+    static void loopAwareTraverse(FunctionAnalysis &analysis, const CompactCFG &cfg, BLOCK_ID node, PATH_ID pathId)
     {
-        map<string, vector<string>> adjacencyList;
+        bool isLoopingBlock = analysis.loops.isHeader(node);
 
-        for (auto it = begin(eList); it != end(eList); ++it)
+        // Check if it is a looping node and have been called already
+        if (analysis.isOutOfBudget() || (isLoopingBlock && analysis.loopAwareVisited[node]))
+        {
+            return;
+        }
+
+        // Back edges only lead to looping blocks that were already visited, so following
+        // the acyclic graph here drops exactly the paths that would be cut short anyway.
+        ArrayRef<BLOCK_ID> children = cfg.getSuccessors(node);
+        ArrayRef<BLOCK_ID> dagChildren = analysis.dagAdjList.getChildren(node);
+        analysis.loopAwareVisited[node] = true;
+        if (children.empty())
+        {
+            // Reached a leaf node. This is a complete path.
+            emitCanonicalPath(analysis, pathId);
+            return;
+        }
+
+        // A header that can leave its loop (a for or while loop, whatever its terminator) is
+        // only followed out of the loop. One that cannot (a do-while loop, or an irreducible
+        // cycle) is followed into its body, which leaves the loop further down.
+        unsigned loop = analysis.loops.getHeadedLoop(node);
+        bool followExitsOnly = false;
+        for (BLOCK_ID child : dagChildren)
+        {
+            followExitsOnly |= isLoopingBlock && analysis.loops.isExitEdge(loop, node, child);
+        }
+        for (unsigned i = 0; i < dagChildren.size(); i++)
         {
-            pair<string, string> temp = *it;
-            if (adjacencyList.find(temp.first) == adjacencyList.end())
+            if (followExitsOnly && !analysis.loops.isExitEdge(loop, node, dagChildren[i]))
             {
-                vector<string> children;
-                children.push_back(temp.second);
-                adjacencyList[temp.first] = children;
-                if (adjacencyList.find(temp.second) == adjacencyList.end())
-                {
-                    vector<string> emptyVector;
-                    adjacencyList[temp.second] = emptyVector;
-                }
+                continue;
             }
-            else
+            loopAwareTraverse(analysis, cfg, dagChildren[i], pathId + analysis.canonicalNumbering.getIncrement(node, i));
+        }
+    }
+
+    // Timed with the expansion and provenance of every path it finds.
+    static void extractCanonicalPaths(FunctionAnalysis &analysis)
+    {
+        PhaseTimer timer("paths", "Path extraction", analysis.function->getName());
+        const CompactCFG &cfg = analysis.cfg;
+        BLOCK_ID rootId = cfg.getRoot();
+        bool logStructure = isLogging(LogStructure);
+        if (analysis.canonicalPathCount > PathEnumerationThreshold)
+        {
+            exhaustBudget(analysis, ThresholdBudget);
+            if (isLogging(LogSummary))
+            {
+                analysis.log() << "Path count is above the enumeration threshold. Skipping canonical path enumeration.\n";
+            }
+        }
+        else if (analysis.loops.empty())
+        {
+            if (logStructure)
             {
-                vector<string> currChildren = adjacencyList[temp.first];
-                currChildren.push_back(temp.second);
-                adjacencyList[temp.first] = currChildren;
-                if (adjacencyList.find(temp.second) == adjacencyList.end())
+                analysis.log() << "No Loop Found. Initiating monolithic traversal.\n";
+            }
+            monolithicTraverse(analysis, analysis.dagAdjList, rootId, 0);
+        }
+        else
+        {
+            if (logStructure)
+            {
+                analysis.log() << "Loop found. Initiating loop aware traversal.\n";
+                vector<BLOCK_ID> loopingBlocks;
+                for (unsigned loop = 0; loop < analysis.loops.size(); loop++)
                 {
-                    vector<string> emptyVector;
-                    adjacencyList[temp.second] = emptyVector;
+                    loopingBlocks.push_back(analysis.loops.getHeader(loop));
                 }
+                printLoopingBlocks(analysis.log(), loopingBlocks, cfg);
+                printBackEdges(analysis.log(), analysis.loops.getBackEdges(), cfg);
             }
+            analysis.loopAwareVisited.assign(cfg.size(), false);
+            loopAwareTraverse(analysis, cfg, rootId, 0);
+        }
+        if (logStructure)
+        {
+            analysis.log() << "******************** directed adjlist ****************\n";
+            printAdjacencyList(analysis.log(), analysis.dagAdjList, cfg);
+            analysis.log() << "\n\n";
         }
+    }
 
-        if (debug)
+    // With recordModel, the paths are also kept for the function's record in the model file.
+    static void attachPathSink(FunctionAnalysis &analysis, PathSinkKind kind, bool recordModel)
+    {
+        if (kind == WritePaths)
+        {
+            analysis.sink.reset(new FilePathSink(analysis.paths()));
+        }
+        else if (kind == CountPaths)
         {
-            printAdjacencyList(adjacencyList);
+            analysis.sink.reset(new CountingPathSink(analysis.log(), isLogging(LogSummary)));
+        }
+        else
+        {
+            analysis.sink.reset(new PrintingPathSink(analysis.log()));
+        }
+        analysis.pathSink = analysis.sink.get();
+        if (DeduplicatePaths)
+        {
+            analysis.deduplicatingSink.reset(new DeduplicatingPathSink(analysis.log(), *analysis.sink, isLogging(LogSummary)));
+            analysis.pathSink = analysis.deduplicatingSink.get();
+        }
+        if (recordModel)
+        {
+            analysis.modelEncoder.reset(new ModelEncoder());
         }
-        return adjacencyList;
     }
 
-    static GRAPH extractDirectedAdjList(GRAPH adjList, map<string, EDGE> bEdges)
+    // Drops the sinks and the streams, so that a cached analysis does not outlive them.
+    static void detachPathSink(FunctionAnalysis &analysis)
     {
-        map<string, vector<string>> directedAcgf;
+        analysis.pathSink = nullptr;
+        analysis.deduplicatingSink.reset();
+        analysis.sink.reset();
+        analysis.modelEncoder.reset();
+        analysis.emittedPathIds.clear();
+        analysis.setOutput(nullptr, nullptr);
+    }
 
-        for (auto &elem : adjList)
+    // The ABB of every block: its calls, inline assembly and typed successors.
+    static void buildAugmentedBlocks(FunctionAnalysis &analysis)
+    {
+        PhaseTimer timer("abb", "ABB construction", analysis.function->getName());
+        const CompactCFG &functionCFG = analysis.cfg;
+        AugmentedCFG &acfg = analysis.acfgNodes;
+        acfg.clear();
+        acfg.reserve(functionCFG.size());
+        for (BLOCK_ID blockId = 0; blockId < functionCFG.size(); blockId++)
         {
-            if (bEdges.find(elem.first) != bEdges.end())
+            // Labels and parents are kept by the CompactCFG under the same block id.
+            acfg.addBlock(blockId);
+            if (blockId == functionCFG.getRoot())
+            {
+                acfg.setFlag(RootBlock);
+            }
+
+            for (const Instruction &instruction : *functionCFG.getBlock(blockId))
             {
-                vector<string> clonedAdjList(elem.second);
-                pair<string, string> edge = bEdges[elem.first];
-                for (vector<string>::iterator it = clonedAdjList.begin(); it != clonedAdjList.end(); ++it)
+                // Invoke and callbr are calls as well as terminators.
+                if (isa<CallBase>(instruction))
                 {
-                    if (*it == edge.second)
-                    {
-                        clonedAdjList.erase(it);
-                        break;
-                    }
+                    Instruction *inst = const_cast<Instruction *>(&instruction);
+                    CallBase *call = dyn_cast<CallBase>(inst);
+                    parseCallInstruction(analysis, call, inst);
                 }
-                directedAcgf[elem.first] = clonedAdjList;
             }
-            else
+            parseTerminator(functionCFG, blockId, acfg);
+        }
+    }
+
+    // The DDG of the function, with values numbered in block and instruction order.
+    static void buildValueDependences(FunctionAnalysis &analysis)
+    {
+        PhaseTimer timer("ddg", "DDG construction", analysis.function->getName());
+        const CompactCFG &functionCFG = analysis.cfg;
+        analysis.ddg.reset(*analysis.function);
+        for (BLOCK_ID blockId = 0; blockId < functionCFG.size(); blockId++)
+        {
+            for (const Instruction &instruction : *functionCFG.getBlock(blockId))
             {
-                vector<string> clonedAdjList(elem.second);
-                directedAcgf[elem.first] = clonedAdjList;
+                parseInstructionForDDG(analysis, const_cast<Instruction &>(instruction));
             }
         }
-        return directedAcgf;
+        NumDDGValues += analysis.ddg.getNumValues();
+        NumDDGEdges += analysis.ddg.getNumEdges();
     }
 
-    static void extractCanonicalPaths(vector<EDGE> eList, map<string, AugmentedBasicBlock> acfgNodes, string rootId)
+    /**
+     * Builds the model of one function once its CFG and loops are built: the ABBs, the DDG,
+     * the acyclic graph, the path counts and the numberings of the loop bodies.
+     * Apart from reading the IR, this only touches the analysis, so it can run on any thread.
+     */
+    static void buildFunctionModel(FunctionAnalysis &analysis)
     {
-        GRAPH adjList = buildAdjacencyList(eList, acfgNodes, true);
-        pair<bool, vector<string>> loopAnalysis = containsLoop(adjList, rootId);
-        canonicalPaths.clear();
-        list<string> initialEmptyPath;
-        if (!loopAnalysis.first)
+        CompactCFG &functionCFG = analysis.cfg;
+        analysis.budgetHits = 0;
+        buildValueDependences(analysis);
+        buildAugmentedBlocks(analysis);
+        // drawDDG("Demo");
+        if (isLogging(LogStructure))
         {
-            errs() << "No Loop Found. Initiating monolithic traversal.\n";
-            monolithicTraverse(adjList, rootId, initialEmptyPath);
+            printEdgeList(analysis.log(), functionCFG);
+            printAdjacencyList(analysis.log(), functionCFG.getSuccessorGraph(), functionCFG);
+            printInlineAssembly(analysis);
         }
-        else
         {
-            errs() << "Loop found. Initiating loop aware traversal.\n";
-            printLoopingBlocks(loopingBlocks);
-            printBackEdges(backEdges);
-            loopAwareTraverse(adjList, acfgNodes, rootId, initialEmptyPath);
+            PhaseTimer timer("counting", "Path counting", analysis.function->getName());
+            analysis.dagAdjList = extractDirectedAdjList(functionCFG.getSuccessorGraph(), analysis.loops);
+            countFunctionPaths(analysis, functionCFG, analysis.dagAdjList);
         }
-        printPaths(canonicalPaths);
-        canonicalAdjList = adjList;
-        dagAdjList = extractDirectedAdjList(canonicalAdjList, backEdges);
-        errs() << "******************** directed adjlist ****************\n";
-        printAdjacencyList(dagAdjList);
-        errs() << "\n\n";
-        // generateProvenanceEdges(acfgNodes);
+        {
+            PhaseTimer timer("loop paths", "Loop body numbering", analysis.function->getName());
+            extractLoopingPaths(analysis, analysis.dagAdjList, functionCFG);
+        }
+        analysis.modelBudgetHits = analysis.budgetHits;
+        analysis.modelBuilt = true;
     }
 
-    static void dagDfsUtil(GRAPH dagGraph, string anchor ,string src, string dst, PATH currentPath){
-        currentPath.push_back(src);
-        if(src == dst){
-            // Enter this in the loops possible execution path. 
-            if(loopingPaths.find(anchor) == loopingPaths.end()){
-                vector<PATH> tempPaths;
-                tempPaths.push_back(currentPath);
-                loopingPaths[anchor] = tempPaths;
+    // Tables of the function in the model file, once its paths were emitted.
+    static void writeFunctionModel(FunctionAnalysis &analysis)
+    {
+        PhaseTimer timer("model", "Model encoding", analysis.function->getName());
+        ModelEncoder &model = *analysis.modelEncoder;
+        const CompactCFG &cfg = analysis.cfg;
+        model.setName(analysis.function->getName());
+
+        static_assert((unsigned)NUM_SUCCESSOR_KINDS == (unsigned)NUM_MODEL_SUCCESSOR_KINDS, "SuccessorKind and ModelSuccessorKind differ");
+        vector<ModelSuccessorRecord> successors;
+        for (BLOCK_ID block = 0; block < cfg.size(); block++)
+        {
+            const AugmentedBasicBlock &abb = analysis.acfgNodes[block];
+            uint32_t flags = 0;
+            if (abb.isARootBlock())
+            {
+                flags |= MODEL_ROOT_BLOCK;
             }
-            else{
-                loopingPaths[anchor].push_back(currentPath);
+            if (abb.getConditionalBlock())
+            {
+                flags |= MODEL_CONDITIONAL_BLOCK;
             }
-            return;
+            if (abb.getInlineAssemblyStatus())
+            {
+                flags |= MODEL_INLINE_ASSEMBLY;
+            }
+            successors.clear();
+            for (const BlockSuccessor &successor : analysis.acfgNodes.getSuccessors(block))
+            {
+                successors.push_back(ModelSuccessorRecord{successor.block, (uint32_t)successor.kind});
+            }
+            model.addBlock(cfg.getLabel(block), flags, analysis.acfgNodes.getFunctions(block), successors, analysis.dagAdjList.getChildren(block));
         }
 
-        EDGE_LIST edge_list = dagGraph[src];
-        for(string child: edge_list){
-            PATH clonedCurrentPath(currentPath);
-            dagDfsUtil(dagGraph, anchor, child, dst, clonedCurrentPath);
+        const LoopForest &loops = analysis.loops;
+        for (unsigned loop = 0; loop < loops.size(); loop++)
+        {
+            model.addLoop(loops.getHeader(loop), loops.getParent(loop) == NO_LOOP ? MODEL_NO_LOOP : loops.getParent(loop), loops.getLatches(loop));
         }
-    }
 
-    static void extractLoopingPaths(GRAPH dagGraph){
-        for(auto &elem: backEdges){
-            EDGE edge = elem.second;
-            PATH curr;
-            dagDfsUtil(dagGraph, edge.second ,edge.second, edge.first, curr);
+        static_assert((unsigned)TimeBudget == (unsigned)MODEL_TIME_BUDGET && NUM_BUDGETS == 5, "AnalysisBudget and ModelBudgetFlags differ");
+        model.addPaths(MODEL_CANONICAL_PATHS, analysis.canonicalNumbering.getSource(), MODEL_ANY_SINK,
+                       analysis.canonicalNumbering.getNumPaths(), analysis.emittedPathIds, analysis.budgetHits);
+        for (auto &elem : analysis.loopingPaths)
+        {
+            for (const BallLarusNumbering &numbering : elem.second)
+            {
+                model.addPaths(MODEL_LOOP_PATHS, numbering.getSource(), numbering.getTarget(), numbering.getNumPaths(), vector<uint64_t>());
+            }
+        }
+
+        const ValueDependenceGraph &ddg = analysis.ddg;
+        const ValueTable &values = ddg.getValues();
+        for (VALUE_ID source = 0; source < ddg.getNumValues(); source++)
+        {
+            model.addValue(values.getName(source), values.getTypeName(values.getType(source)));
+            for (const ValueDependence &edge : ddg.getEdges(source))
+            {
+                model.addDependence(edge.target, ddg.getLabelString(edge));
+            }
         }
-        printLoopExecutionPaths(loopingPaths);
     }
 
-    static vector<PATH> expandPath(PATH p){
-        
-        vector<PATH> expandedPaths;
-        PATH initializer;
-        expandedPaths.push_back(initializer);
-        // errs()<<"Called ExpandPath for: ";
-        // printPath(p);
-        // errs()<<"\n";
-        for(string n:p){
-            if(find(loopingBlocks.begin(), loopingBlocks.end(), n) == loopingBlocks.end()){
-                // Not a looping block.
-                // errs()<<"Not a looping block: "<<n<<"\n";
-                for(PATH &tempPath: expandedPaths){
-                    // errs()<<"Pushing back "<<n<<"\n";
-                    tempPath.push_back(n);
-                    // printPath(tempPath);
-                }
-                // printPaths(expandedPaths);
-            }
-            else if(n!= "LOOP_START" && n!= "LOOP_END"){
-                // errs()<<"Looping Block."<<n<<"\n";
-                for(PATH &tempPath: expandedPaths){
-                    tempPath.push_back("LOOP_START");
-                    tempPath.push_back(n);
-                    // printPath(tempPath);
-                }
-                
-                vector<PATH> candidatePaths = loopingPaths[n];
-                vector<PATH> innerExpandedPaths;
-                for(PATH &cPath: candidatePaths){
-                    PATH temp(cPath);
-                    temp.erase(temp.begin());
-                    if(temp.empty()){
-                        continue;
-                    }
-                    vector<PATH> tempInnerPaths = expandPath(temp);
-                    innerExpandedPaths.insert(innerExpandedPaths.end(), tempInnerPaths.begin(), tempInnerPaths.end()) ;
-                    // append every path in innerexapndedpaths (n) to every path in the current expanded paths (m). 
-                    // So the new expanded paths will have m*n paths
-                }
-                vector<PATH> tempHolder;
-                for(PATH &tempPath: expandedPaths){
-                    for(PATH &x: innerExpandedPaths){
-                        PATH clonedTempPath(tempPath);
-                        clonedTempPath.insert(clonedTempPath.end(), x.begin(), x.end());
-                        tempHolder.push_back(clonedTempPath);
-                    }
-                }
+    /**
+     * Extracts the paths of one function into its sink, building its model first unless that
+     * was done ahead of time. Apart from reading the IR and relevantFunctions, this only
+     * touches the analysis, so it can run on any thread. A function that runs out of a budget
+     * keeps the paths emitted before, and is reported as approximated.
+     */
+    static void analyzeFunction(FunctionAnalysis &analysis)
+    {
+        ++NumFunctions;
+        if (analysis.modelBuilt)
+        {
+            analysis.log() << analysis.modelLog;
+            analysis.budgetHits = analysis.modelBudgetHits;
+        }
+        else
+        {
+            buildFunctionModel(analysis);
+        }
+        analysis.emittedPaths = 0;
+        analysis.deadline = chrono::steady_clock::now() + chrono::milliseconds(FunctionTimeBudget);
+        analysis.pathSink->beginFunction(*analysis.function, analysis.cfg);
+        extractCanonicalPaths(analysis);
+        if (analysis.budgetHits != 0)
+        {
+            ++NumApproximatedFunctions;
+            string budgets = getBudgetNames(analysis.budgetHits);
+            if (isLogging(LogSummary))
+            {
+                analysis.log() << "Function is approximated, out of budget: " << budgets << ". " << analysis.emittedPaths
+                               << " paths were emitted.\n";
+            }
+            analysis.pathSink->approximateFunction(budgets);
+        }
+        analysis.pathSink->endFunction();
+        if (analysis.modelEncoder)
+        {
+            writeFunctionModel(analysis);
+        }
+    }
 
-                expandedPaths.clear();
-                for(PATH &x:tempHolder){
-                    expandedPaths.push_back(x);
-                }
+    // Must run on the pass manager's thread. Function analyses are only valid until the pass
+    // manager moves on, which is why the loops are copied out.
+    static void prepareFunction(FunctionAnalysis &analysis, const Function &function, const LoopInfo &loopInfo, const DominatorTree &domTree)
+    {
+        PhaseTimer timer("loops", "CFG and loop detection", function.getName());
+        analysis.cfg.build(function);
+        analysis.loops.build(analysis.cfg, loopInfo, domTree);
+        NumBlocks += analysis.cfg.size();
+        NumEdges += analysis.cfg.getSuccessorGraph().getNumEdges();
+        NumLoops += analysis.loops.size();
+        NumBackEdges += analysis.loops.getBackEdges().size();
+    }
 
-                for(PATH &tempPath: expandedPaths){
-                    tempPath.push_back("LOOP_END");
-                }
+    /**
+     * One model file per module, so that modules of a build do not overwrite each other. It is named
+     * after the module's source file, followed by a hash of that file's absolute path, so that two
+     * files with the same name in different directories get different models.
+     */
+    static string getModelFileName(const Module &M, StringRef directory)
+    {
+        SmallString<256> sourcePath(M.getSourceFileName().empty() ? StringRef(M.getModuleIdentifier()) : StringRef(M.getSourceFileName()));
+        sys::fs::make_absolute(sourcePath);
+        sys::path::remove_dots(sourcePath, true);
+        MD5 hash;
+        hash.update(sourcePath.str());
+        MD5::MD5Result pathHash;
+        hash.final(pathHash);
+
+        string name = sys::path::filename(M.getSourceFileName()).str();
+        if (name.empty())
+        {
+            name = "module";
+        }
+        for (char &c : name)
+        {
+            if (!isalnum((unsigned char)c) && c != '.' && c != '_' && c != '-')
+            {
+                c = '_';
             }
         }
-        return expandedPaths;
+        SmallString<128> path(directory);
+        sys::path::append(path, name + "." + utohexstr(pathHash.low() & 0xffffffff, true, 8) + ".rpem");
+        return path.str().str();
     }
 
-    /**
-     * We take the Canonical Paths here and Expand It Using the looping block paths. 
-     * Then We push the extended path in a stack.
-     * And then Instantiate it by naively executing the loops by sampling them.
-    */
-    static void generatePathsFromCanonicalPaths(){
-        for(PATH p:canonicalPaths){
-            vector<PATH> extractedPaths = expandPath(p);
-            errs()<<"\n\n";
-            printPaths(extractedPaths);
-        }    
+    // Returns the analysis of a function with at least its CFG and loops built. An analysis it creates
+    // is handed over through its second argument, and destroyed once its paths are written out.
+    typedef function_ref<FunctionAnalysis &(Function &, unique_ptr<FunctionAnalysis> &)> PREPARE_FUNCTION;
+
+    // Everything the output of a function depends on besides its IR, for its key in the cache.
+    static string getCacheOptions(PathSinkKind sinkKind)
+    {
+        string options;
+        raw_string_ostream out(options);
+        out << "model " << MODEL_VERSION << ", threshold " << PathEnumerationThreshold << ", budgets " << MaxFunctionPaths
+            << " " << MaxExpandedPathLength << " " << MaxLoopExpansionDepth << " " << FunctionTimeBudget << ", sink " << sinkKind
+            << ", dedup " << DeduplicatePaths << ", verbose " << Verbosity << ", provenance " << GenerateProvenance
+            << ", catalog " << getRelevantFunctionCatalog().getDigest();
+        return out.str();
     }
 
-    struct BasicBlockExtractionPass : public ModulePass
+    // Provenance edges also depend on the summaries of the functions called, which change with their bodies.
+    static CACHE_KEY getCacheKey(const Function &function, const string &options)
     {
-        static char ID;
-        BasicBlockExtractionPass() : ModulePass(ID){};
-        virtual bool runOnModule(Module &M)
+        if (!GenerateProvenance)
         {
-            for (Module::iterator functionIt = M.begin(), endFunctionIt = M.end(); functionIt != endFunctionIt; ++functionIt)
+            return getFunctionCacheKey(function, options);
+        }
+        string calleeOptions = options;
+        raw_string_ostream out(calleeOptions);
+        out << "\n";
+        provenanceSummaries.printCalleeSummaries(function, out);
+        return getFunctionCacheKey(function, out.str());
+    }
+
+    // Writes out the results of an analyzed function and keeps them in the cache. Only called on one thread, in module order.
+    static void finishFunction(FunctionAnalysis &analysis, raw_ostream &log, raw_ostream *paths, ModelFileWriter *models,
+                               const AnalysisCache *cache, const CACHE_KEY &key)
+    {
+        // What a function emits before running out of time differs from run to run.
+        if (cache && !(analysis.budgetHits & TimeBudget))
+        {
+            cache->store(key, analysis.getBufferedLog(), analysis.getBufferedPaths(), *analysis.modelEncoder);
+        }
+        analysis.flush(log, paths);
+        if (models)
+        {
+            models->addFunction(*analysis.modelEncoder);
+        }
+        detachPathSink(analysis);
+    }
+
+    // Writes out the results of a function the cache had, as if it was analyzed again.
+    static void replayFunction(const CachedAnalysis &cached, raw_ostream &log, raw_ostream *paths, ModelFileWriter *models)
+    {
+        log << cached.log;
+        if (paths)
+        {
+            *paths << cached.paths;
+        }
+        if (models)
+        {
+            models->addFunction(cached.model);
+        }
+    }
+
+    /**
+     * Extracts the paths of every function of a module, in module order, for either pass manager.
+     * prepare is only ever called on the calling thread. With -rpe-cache-dir, functions the cache
+     * has are not prepared at all.
+     */
+    static void extractModulePaths(Module &M, PREPARE_FUNCTION prepare)
+    {
+        TimeTraceScope trace("Relevant path extraction", M.getName());
+        PathSinkKind sinkKind = PathSinkOption;
+        unique_ptr<raw_fd_ostream> pathFile;
+        if (sinkKind == WritePaths)
+        {
+            error_code ec;
+            pathFile.reset(new raw_fd_ostream(PathFileName, ec));
+            if (ec)
+            {
+                errs() << "ERROR: Could not open " << PathFileName << ": " << ec.message() << ". Printing paths instead.\n";
+                pathFile.reset();
+                sinkKind = PrintPaths;
+            }
+        }
+        unique_ptr<ModelFileWriter> modelFile;
+        string modelFileName;
+        if (!ModelDirectory.empty())
+        {
+            modelFileName = getModelFileName(M, ModelDirectory);
+            error_code ec = sys::fs::create_directories(ModelDirectory);
+            string error = ec ? ec.message() : "";
+            modelFile.reset(new ModelFileWriter());
+            if (ec || !modelFile->open(modelFileName, error))
             {
-                const Function &currentFunction = *functionIt;
-                errs() << "Current Function: " << currentFunction.getName() << "\n";
-                map<string, AugmentedBasicBlock> idAcfgNode;
-                vector<pair<string, string>> edgeList;
-                string rootBlockId;
+                errs() << "ERROR: Could not open " << modelFileName << ": " << error << ". Not writing models.\n";
+                modelFile.reset();
+            }
+        }
+        unique_ptr<AnalysisCache> cache;
+        string cacheOptions = getCacheOptions(sinkKind);
+        if (!CacheDirectory.empty())
+        {
+            string error;
+            cache.reset(new AnalysisCache());
+            if (!cache->open(CacheDirectory, error))
+            {
+                errs() << "ERROR: Could not create " << CacheDirectory << ": " << error << ". Not caching results.\n";
+                cache.reset();
+            }
+        }
+        bool recordModel = modelFile || cache; // The cache keeps the model, for runs that write it
+        unsigned numFunctions = 0;
+        unsigned numCached = 0;
+        relevantFunctions.resolve(M, getRelevantFunctionCatalog());
+        if (GenerateProvenance)
+        {
+            PhaseTimer timer("summaries", "Provenance summaries", M.getName());
+            provenanceSummaries.build(M, relevantFunctions);
+        }
 
+        // DOT files are written by their own thread, so that the analysis never waits on them.
+        unique_ptr<ThreadPool> dotWriter;
+        if (!CFGDumpDirectory.empty())
+        {
+            error_code ec = sys::fs::create_directories(CFGDumpDirectory);
+            if (ec)
+            {
+                errs() << "ERROR: Could not create " << CFGDumpDirectory << ": " << ec.message() << ". Not writing CFGs.\n";
+            }
+            else
+            {
+                dotWriter.reset(new ThreadPool(hardware_concurrency(1)));
+            }
+        }
 
+        // errs() is unbuffered, which makes every small write a system call.
+        raw_fd_ostream log(fileno(stderr), false);
+        log.SetBufferSize(1 << 16);
+
+        // With more than one thread every function is queued up front and buffers its output,
+        // which is written out below in module order whatever order the functions finish in.
+        unique_ptr<ThreadPool> pool;
+        vector<unique_ptr<FunctionAnalysis>> ownedAnalyses;
+        vector<FunctionAnalysis *> analyses; // Null for the functions the cache had
+        vector<shared_future<void>> results;
+        vector<unique_ptr<CachedAnalysis>> cachedAnalyses;
+        vector<CACHE_KEY> cacheKeys;
+        if (AnalysisThreads != 1)
+        {
+            pool.reset(new ThreadPool(hardware_concurrency(AnalysisThreads)));
+            for (Function &currentFunction : M)
+            {
                 if (currentFunction.getBasicBlockList().size() == 0)
                 {
                     continue;
                 }
-
-                currentFunction.viewCFG();
-                for (auto &basicBlock : currentFunction)
+                ownedAnalyses.emplace_back();
+                cachedAnalyses.emplace_back();
+                cacheKeys.emplace_back();
+                results.emplace_back();
+                if (cache)
                 {
-                    AugmentedBasicBlock acfgNode;
-
-                    const BasicBlock *rootBlock = NULL;
-                    const BasicBlock *predecessor = NULL;
-                    vector<BasicBlock *> predecessorNodes;
-
-                    bool isRootBlock = false;
-                    bool hasUniquePredecessor = false;
-                    bool hasMultiplePredecessors = false;
-
-                    acfgNode.setBlockId(getSimpleNodeLabel(basicBlock));
-
-                    if (basicBlock.hasNPredecessors(1))
-                    {
-                        predecessor = basicBlock.getUniquePredecessor();
-                        hasUniquePredecessor = true;
-                        string parentName = getSimpleNodeLabel(predecessor);
-                        acfgNode.addParent(parentName);
-                        edgeList.push_back(make_pair(parentName, acfgNode.getBlockId()));
-                    }
-                    else if (basicBlock.hasNPredecessorsOrMore(2))
-                    {
-                        BasicBlock *pointerToCurrentBlock = const_cast<BasicBlock *>(&basicBlock);
-                        if (pointerToCurrentBlock != NULL)
-                        {
-                            for (BasicBlock *predecessor : predecessors(pointerToCurrentBlock))
-                            {
-                                string tempParent = getSimpleNodeLabel(predecessor);
-                                acfgNode.addParent(tempParent);
-                                predecessorNodes.push_back(predecessor);
-                                edgeList.push_back(make_pair(tempParent, acfgNode.getBlockId()));
-                            }
-                            hasMultiplePredecessors = true;
-                        }
-                        else
-                        {
-                            errs() << "ERROR: The const to non-const conversion may have gone wrong.\n";
-                            continue;
-                        }
-                    }
-                    else
+                    cacheKeys.back() = getCacheKey(currentFunction, cacheOptions);
+                    cachedAnalyses.back().reset(new CachedAnalysis());
+                    if (cache->load(cacheKeys.back(), *cachedAnalyses.back()))
                     {
-                        rootBlock = const_cast<BasicBlock *>(&basicBlock);
-                        rootBlockId = getSimpleNodeLabel(rootBlock);
-                        isRootBlock = true;
-                        acfgNode.setRootBlock();
+                        analyses.push_back(nullptr);
+                        continue;
                     }
+                    cachedAnalyses.back().reset();
+                }
+                FunctionAnalysis *analysis = &prepare(currentFunction, ownedAnalyses.back());
+                analyses.push_back(analysis);
+                analysis->setOutput(nullptr, nullptr);
+                attachPathSink(*analysis, sinkKind, recordModel);
+                results.back() = pool->async([analysis]()
+                                             { analyzeFunction(*analysis); });
+            }
+        }
 
-                    for (auto &instruction : basicBlock)
-                    {
-                        parseInstructionForDDG(const_cast<Instruction &>(instruction));
+        unsigned nextResult = 0;
+        for (Module::iterator functionIt = M.begin(), endFunctionIt = M.end(); functionIt != endFunctionIt; ++functionIt)
+        {
+            Function &currentFunction = *functionIt;
+            if (isLogging(LogSummary))
+            {
+                log << "Current Function: " << currentFunction.getName() << "\n";
+            }
 
-                        if (isa<CallInst>(instruction))
-                        {
-                            Instruction *inst = const_cast<Instruction *>(&instruction);
-                            CallInst *call = dyn_cast<CallInst>(inst);
-                            parseCallInstruction(call, inst, &acfgNode);
-                        }
-                        else if (isa<BranchInst>(instruction))
-                        {
-                            Instruction *inst = const_cast<Instruction *>(&instruction);
-                            BranchInst *brInst = dyn_cast<BranchInst>(inst);
-                            parseBinaryBranchInstruction(brInst, &acfgNode);
-                        }
-                        else if (isa<SwitchInst>(instruction))
-                        {
-                            // [TODO]
-                        }
-                    }
+            if (currentFunction.getBasicBlockList().size() == 0)
+            {
+                continue;
+            }
+
+            if (dotWriter)
+            {
+                const Function *function = &currentFunction;
+                dotWriter->async([function]()
+                                 { writeDotFile(*function, CFGDumpDirectory); });
+            }
+            numFunctions++;
+            if (pool)
+            {
+                if (analyses[nextResult] == nullptr)
+                {
+                    replayFunction(*cachedAnalyses[nextResult], log, pathFile.get(), modelFile.get());
+                    cachedAnalyses[nextResult].reset();
+                    numCached++;
+                    ++NumCachedFunctions;
+                }
+                else
+                {
+                    results[nextResult].wait();
+                    finishFunction(*analyses[nextResult], log, pathFile.get(), modelFile.get(), cache.get(), cacheKeys[nextResult]);
+                    ownedAnalyses[nextResult].reset();
+                }
+                nextResult++;
+                continue;
+            }
 
-                    idAcfgNode[acfgNode.getBlockId()] = acfgNode;
+            CACHE_KEY key;
+            if (cache)
+            {
+                key = getCacheKey(currentFunction, cacheOptions);
+                CachedAnalysis cached;
+                if (cache->load(key, cached))
+                {
+                    replayFunction(cached, log, pathFile.get(), modelFile.get());
+                    numCached++;
+                    ++NumCachedFunctions;
+                    continue;
                 }
-                // drawDDG("Demo");
-                printEdgeList(edgeList);
-                extractCanonicalPaths(edgeList, idAcfgNode, rootBlockId);
-                extractLoopingPaths(dagAdjList);
-                generatePathsFromCanonicalPaths();        
-                // bool test1 = checkLoadStoreSequenceBetweenNodesinDDG("%17","%20");
-                // bool test2 = checkLoadStoreSequenceBetweenNodesinDDG("%17","%24");
-                // bool test3 = checkLoadStoreSequenceBetweenNodesinDDG("%24", "%28");
-
-                // errs()<<test1<<" "<<test2<<" "<<test3<<"\n";
-                // writeDDGToFile("ddgedges.txt");
             }
+            unique_ptr<FunctionAnalysis> ownedAnalysis;
+            FunctionAnalysis &analysis = prepare(currentFunction, ownedAnalysis);
+            // Results to be cached are buffered first.
+            analysis.setOutput(cache ? nullptr : &log, cache ? nullptr : pathFile.get());
+            attachPathSink(analysis, sinkKind, recordModel);
+            analyzeFunction(analysis);
+            finishFunction(analysis, log, pathFile.get(), modelFile.get(), cache.get(), key);
+        }
+        if (cache && isLogging(LogSummary))
+        {
+            log << "Reused the cached results of " << numCached << " of " << numFunctions << " functions.\n";
+        }
+        // The IR may change once the pass returns.
+        if (dotWriter)
+        {
+            dotWriter->wait();
+        }
+        string error;
+        if (modelFile && !modelFile->close(error))
+        {
+            errs() << "ERROR: Could not write " << modelFileName << ": " << error << "\n";
+        }
+    }
+
+    struct BasicBlockExtractionPass : public ModulePass
+    {
+        static char ID;
+        BasicBlockExtractionPass() : ModulePass(ID){};
+
+        void getAnalysisUsage(AnalysisUsage &AU) const override
+        {
+            AU.addRequired<DominatorTreeWrapperPass>();
+            AU.addRequired<LoopInfoWrapperPass>();
+            AU.setPreservesAll();
+        }
+
+        virtual bool runOnModule(Module &M)
+        {
+            extractModulePaths(M, [this](Function &function, unique_ptr<FunctionAnalysis> &owned) -> FunctionAnalysis &
+                               {
+                                   owned.reset(new FunctionAnalysis(function));
+                                   prepareFunction(*owned, function,
+                                                   getAnalysis<LoopInfoWrapperPass>(function).getLoopInfo(),
+                                                   getAnalysis<DominatorTreeWrapperPass>(function).getDomTree());
+                                   return *owned;
+                               });
             return false;
         }
     };
 
+    /**
+     * New pass manager analysis of one function: its CFG, loops and model, built from the cached
+     * LoopInfo and DominatorTree. The result stays cached, and shared with any other pass of the
+     * pipeline, until a pass changes the function without preserving it.
+     */
+    class BlockExtractionAnalysis : public AnalysisInfoMixin<BlockExtractionAnalysis>
+    {
+        friend AnalysisInfoMixin<BlockExtractionAnalysis>;
+        static AnalysisKey Key;
+
+    public:
+        struct Result
+        {
+            unique_ptr<FunctionAnalysis> analysis;
+        };
+
+        Result run(Function &function, FunctionAnalysisManager &FAM)
+        {
+            Result result;
+            result.analysis.reset(new FunctionAnalysis(function));
+            prepareFunction(*result.analysis, function, FAM.getResult<LoopAnalysis>(function), FAM.getResult<DominatorTreeAnalysis>(function));
+            buildFunctionModel(*result.analysis);
+            result.analysis->keepModelLog();
+            return result;
+        }
+    };
+
+    AnalysisKey BlockExtractionAnalysis::Key;
+
+    /**
+     * The pass for the new pass manager. Models come from BlockExtractionAnalysis on the pass
+     * manager's thread, so with -rpe-threads only the path extraction runs in parallel.
+     */
+    struct BasicBlockExtractionModulePass : public PassInfoMixin<BasicBlockExtractionModulePass>
+    {
+        PreservedAnalyses run(Module &M, ModuleAnalysisManager &MAM)
+        {
+            FunctionAnalysisManager &FAM = MAM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+            extractModulePaths(M, [&FAM](Function &function, unique_ptr<FunctionAnalysis> &owned) -> FunctionAnalysis &
+                               { return *FAM.getResult<BlockExtractionAnalysis>(function).analysis; });
+            return PreservedAnalyses::all();
+        }
+    };
+
 }
 
 char BasicBlockExtractionPass::ID = 0;
@@ -872,4 +1697,26 @@ static void registerBasicBlockAndLoopPass(const PassManagerBuilder &, legacy::Pa
     PM.add(new BasicBlockExtractionPass());
 }
 
-static RegisterStandardPasses RegisterCustomBasicBlockPass(PassManagerBuilder::EP_EarlyAsPossible, registerBasicBlockAndLoopPass);
\ No newline at end of file
+static RegisterStandardPasses RegisterCustomBasicBlockPass(PassManagerBuilder::EP_EarlyAsPossible, registerBasicBlockAndLoopPass);
+
+// Entry point of -load-pass-plugin, for opt -passes=basic-block-extract and the default pipelines.
+extern "C" LLVM_ATTRIBUTE_WEAK PassPluginLibraryInfo llvmGetPassPluginInfo()
+{
+    return {LLVM_PLUGIN_API_VERSION, "BlockExtractPass", LLVM_VERSION_STRING, [](PassBuilder &PB)
+            {
+                PB.registerAnalysisRegistrationCallback([](FunctionAnalysisManager &FAM)
+                                                        { FAM.registerPass([]()
+                                                                           { return BlockExtractionAnalysis(); }); });
+                PB.registerPipelineParsingCallback([](StringRef name, ModulePassManager &MPM, ArrayRef<PassBuilder::PipelineElement>)
+                                                   {
+                                                       if (name != "basic-block-extract")
+                                                       {
+                                                           return false;
+                                                       }
+                                                       MPM.addPass(BasicBlockExtractionModulePass());
+                                                       return true;
+                                                   });
+                PB.registerPipelineStartEPCallback([](ModulePassManager &MPM, OptimizationLevel)
+                                                   { MPM.addPass(BasicBlockExtractionModulePass()); });
+            }};
+}
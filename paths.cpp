@@ -0,0 +1,263 @@
+#ifndef RPE_PATHS_CPP
+#define RPE_PATHS_CPP
+
+#include "cfg.cpp"
+
+// LLVM dependencies
+#include "llvm/ADT/STLFunctionalExtras.h"
+#include "llvm/Support/MathExtras.h"
+
+using namespace llvm;
+using namespace std;
+
+typedef uint64_t PATH_COUNT;
+typedef uint64_t PATH_ID;
+
+// Path counts saturate at this value instead of wrapping around.
+static const PATH_COUNT SATURATED_PATH_COUNT = numeric_limits<PATH_COUNT>::max();
+
+// Passed as the target of a count when every sink of the graph ends a path.
+static const BLOCK_ID ANY_SINK = ~0u;
+
+namespace
+{
+    static string formatPathCount(PATH_COUNT count)
+    {
+        if (count == SATURATED_PATH_COUNT)
+        {
+            return "more than " + to_string(SATURATED_PATH_COUNT - 1);
+        }
+        return to_string(count);
+    }
+
+    /**
+     * Iterative post order of the nodes reachable from root.
+     * Recursion is avoided because generated code can have very deep CFGs.
+     */
+    static void computePostOrder(const CSRGraph &graph, BLOCK_ID root, vector<BLOCK_ID> &postOrder)
+    {
+        postOrder.clear();
+        vector<bool> seen(graph.getNumNodes(), false);
+        vector<pair<BLOCK_ID, unsigned>> workList;
+
+        seen[root] = true;
+        workList.push_back(make_pair(root, 0));
+        while (!workList.empty())
+        {
+            BLOCK_ID node = workList.back().first;
+            unsigned nextChild = workList.back().second;
+            ArrayRef<BLOCK_ID> children = graph.getChildren(node);
+            if (nextChild == children.size())
+            {
+                postOrder.push_back(node);
+                workList.pop_back();
+                continue;
+            }
+            workList.back().second++;
+            BLOCK_ID child = children[nextChild];
+            if (!seen[child])
+            {
+                seen[child] = true;
+                workList.push_back(make_pair(child, 0));
+            }
+        }
+    }
+
+    /**
+     * Counts the paths from source to target in an acyclic graph without enumerating them.
+     * numPaths[n] receives the number of paths from n to the target (0 for nodes that cannot reach it,
+     * or that were not reached from source). A path stops at the first visit of the target, and with
+     * target == ANY_SINK every node without children ends a path.
+     * Each child c is weighted by weight(c), which lets callers account for blocks that expand into
+     * several sub-paths. Arithmetic saturates at SATURATED_PATH_COUNT.
+     */
+    static PATH_COUNT countPaths(const CSRGraph &dag, BLOCK_ID source, BLOCK_ID target, vector<PATH_COUNT> &numPaths,
+                                 function_ref<PATH_COUNT(BLOCK_ID)> weight)
+    {
+        vector<BLOCK_ID> postOrder;
+        computePostOrder(dag, source, postOrder);
+        numPaths.assign(dag.getNumNodes(), 0);
+
+        for (BLOCK_ID node : postOrder)
+        {
+            ArrayRef<BLOCK_ID> children = dag.getChildren(node);
+            if (node == target || (target == ANY_SINK && children.empty()))
+            {
+                numPaths[node] = 1;
+                continue;
+            }
+            PATH_COUNT total = 0;
+            for (BLOCK_ID child : children)
+            {
+                if (numPaths[child] != 0)
+                {
+                    total = SaturatingMultiplyAdd(weight(child), numPaths[child], total);
+                }
+            }
+            numPaths[node] = total;
+        }
+        return numPaths[source];
+    }
+
+    static PATH_COUNT countPaths(const CSRGraph &dag, BLOCK_ID source, BLOCK_ID target, vector<PATH_COUNT> &numPaths)
+    {
+        return countPaths(dag, source, target, numPaths, [](BLOCK_ID) -> PATH_COUNT { return 1; });
+    }
+
+    /**
+     * Ball-Larus numbering of the paths between two blocks of an acyclic graph.
+     * Every edge gets an increment such that the sum of the increments along a path is a
+     * unique id in [0, getNumPaths()). Only a count per block and an increment per edge are
+     * kept, and the blocks of a path are rebuilt from its id when they are needed.
+     * Ids are only unique while the path count is not saturated.
+     * The numbering refers to the graph it was built on, which must outlive it.
+     */
+    class BallLarusNumbering
+    {
+    private:
+        const CSRGraph *dag;
+        BLOCK_ID source;
+        BLOCK_ID target;
+        vector<PATH_COUNT> numPaths;
+        vector<PATH_ID> increments; // Indexed like the edges of the graph
+
+        bool endsPath(BLOCK_ID node) const
+        {
+            return node == target || (target == ANY_SINK && dag->getChildren(node).empty());
+        }
+
+    public:
+        BallLarusNumbering()
+        {
+            dag = nullptr;
+            source = 0;
+            target = ANY_SINK;
+        }
+
+        void build(const CSRGraph &dagGraph, BLOCK_ID from, BLOCK_ID to = ANY_SINK)
+        {
+            dag = &dagGraph;
+            source = from;
+            target = to;
+            countPaths(dagGraph, from, to, numPaths);
+
+            increments.assign(dagGraph.getNumEdges(), 0);
+            for (BLOCK_ID node = 0; node < dagGraph.getNumNodes(); node++)
+            {
+                if (numPaths[node] == 0 || endsPath(node))
+                {
+                    continue;
+                }
+                ArrayRef<BLOCK_ID> children = dagGraph.getChildren(node);
+                unsigned firstEdge = dagGraph.getFirstEdge(node);
+                PATH_ID running = 0;
+                for (unsigned i = 0; i < children.size(); i++)
+                {
+                    increments[firstEdge + i] = running;
+                    running = SaturatingAdd(running, numPaths[children[i]]);
+                }
+            }
+        }
+
+        BLOCK_ID getSource() const
+        {
+            return source;
+        }
+        BLOCK_ID getTarget() const
+        {
+            return target;
+        }
+        PATH_COUNT getNumPaths() const
+        {
+            return dag == nullptr ? 0 : numPaths[source];
+        }
+        bool isExact() const
+        {
+            return getNumPaths() != SATURATED_PATH_COUNT;
+        }
+
+        // Increment of the childIndex-th edge leaving node.
+        PATH_ID getIncrement(BLOCK_ID node, unsigned childIndex) const
+        {
+            return increments[dag->getFirstEdge(node) + childIndex];
+        }
+
+        // Increment of the first edge from node to child. Fails if the graph has no such edge.
+        bool getIncrement(BLOCK_ID node, BLOCK_ID child, PATH_ID &increment) const
+        {
+            ArrayRef<BLOCK_ID> children = dag->getChildren(node);
+            for (unsigned i = 0; i < children.size(); i++)
+            {
+                if (children[i] == child)
+                {
+                    increment = getIncrement(node, i);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        PATH_ID getPathId(const PATH &path) const
+        {
+            PATH_ID id = 0;
+            for (unsigned i = 1; i < path.size(); i++)
+            {
+                PATH_ID increment = 0;
+                getIncrement(path[i - 1], path[i], increment);
+                id += increment;
+            }
+            return id;
+        }
+
+        void regeneratePath(PATH_ID id, PATH &path) const
+        {
+            assert(id < getNumPaths() && "Path id out of range");
+            path.clear();
+            BLOCK_ID node = source;
+            path.push_back(node);
+            while (!endsPath(node))
+            {
+                // The taken edge is the last one whose increment does not exceed the remaining id.
+                ArrayRef<BLOCK_ID> children = dag->getChildren(node);
+                unsigned taken = 0;
+                for (unsigned i = 0; i < children.size(); i++)
+                {
+                    if (numPaths[children[i]] != 0 && getIncrement(node, i) <= id)
+                    {
+                        taken = i;
+                    }
+                }
+                id -= getIncrement(node, taken);
+                node = children[taken];
+                path.push_back(node);
+            }
+        }
+    };
+
+    static void printLoopExecutionPaths(raw_ostream &out, const map<BLOCK_ID, vector<BallLarusNumbering>> &pathsInLoops, const CompactCFG &cfg)
+    {
+        for (auto &elem : pathsInLoops)
+        {
+            PATH_COUNT numberOfPaths = 0;
+            for (const BallLarusNumbering &numbering : elem.second)
+            {
+                numberOfPaths = SaturatingAdd(numberOfPaths, numbering.getNumPaths());
+            }
+            out << "There are " << formatPathCount(numberOfPaths) << " in the loop anchored at: " << cfg.getLabel(elem.first) << "\n";
+
+            int pathNum = 0;
+            PATH path;
+            for (const BallLarusNumbering &numbering : elem.second)
+            {
+                for (PATH_ID id = 0; id < numbering.getNumPaths(); id++)
+                {
+                    out << "Path Number: " << ++pathNum << " Path Id: " << id << "\n";
+                    numbering.regeneratePath(id, path);
+                    printPath(out, path, cfg);
+                }
+            }
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,264 @@
+#ifndef RPE_SINK_CPP
+#define RPE_SINK_CPP
+
+#include "paths.cpp"
+
+// LLVM dependencies
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/Hashing.h"
+#include "llvm/Support/xxhash.h"
+
+using namespace llvm;
+using namespace std;
+
+namespace
+{
+    /**
+     * Receives the paths of a function one at a time, as soon as a traversal finds them.
+     * The traversals keep nothing once a path is handed over, so the memory a sink needs
+     * is entirely up to the sink. Every function gets its own sink, so a sink is only ever
+     * used by one thread.
+     */
+    class PathSink
+    {
+    public:
+        virtual ~PathSink() {}
+
+        virtual void beginFunction(const Function &function, const CompactCFG &cfg) {}
+        // A path from the root block to an exit block, with its id under the function's Ball-Larus numbering.
+        virtual void consumeCanonicalPath(PATH_ID id, const PATH &path) {}
+        // A canonical path whose loops were expanded in place, between LOOP_START and LOOP_END markers.
+        virtual void consumeExpandedPath(const PATH &path) {}
+        // The function ran out of the named budgets, so the paths before are only some of its paths.
+        virtual void approximateFunction(StringRef budgets) {}
+        virtual void endFunction() {}
+    };
+
+    /**
+     * Prints every path to the function's log, in the format the pass always used.
+     */
+    class PrintingPathSink : public PathSink
+    {
+    private:
+        raw_ostream &out;
+        const CompactCFG *cfg;
+        int canonicalNum;
+        int expandedNum;
+
+    public:
+        PrintingPathSink(raw_ostream &output) : out(output)
+        {
+            cfg = nullptr;
+            canonicalNum = 0;
+            expandedNum = 0;
+        }
+
+        void beginFunction(const Function &function, const CompactCFG &functionCFG) override
+        {
+            cfg = &functionCFG;
+            canonicalNum = 0;
+        }
+        void consumeCanonicalPath(PATH_ID id, const PATH &path) override
+        {
+            out << "Path Number: " << ++canonicalNum << " Path Id: " << id << "\n";
+            printPath(out, path, *cfg);
+            expandedNum = 0;
+        }
+        void consumeExpandedPath(const PATH &path) override
+        {
+            out << "Expanded Path Number: " << ++expandedNum << "\n";
+            printPath(out, path, *cfg);
+        }
+    };
+
+    /**
+     * Appends every path to a stream, one per line:
+     *   function,canonical,<path id>,<block> <block> ...
+     *   function,expanded,<block> <block> ...
+     *   function,approximated,<budget> <budget> ...
+     */
+    class FilePathSink : public PathSink
+    {
+    private:
+        raw_ostream &output;
+        const CompactCFG *cfg;
+        string functionName;
+
+        void writeBlocks(const PATH &path)
+        {
+            for (unsigned i = 0; i < path.size(); i++)
+            {
+                if (i != 0)
+                {
+                    output << " ";
+                }
+                output << cfg->getLabel(path[i]);
+            }
+            output << "\n";
+        }
+
+    public:
+        FilePathSink(raw_ostream &pathOutput) : output(pathOutput)
+        {
+            cfg = nullptr;
+        }
+
+        void beginFunction(const Function &function, const CompactCFG &functionCFG) override
+        {
+            cfg = &functionCFG;
+            functionName = function.getName().str();
+        }
+        void consumeCanonicalPath(PATH_ID id, const PATH &path) override
+        {
+            output << functionName << ",canonical," << id << ",";
+            writeBlocks(path);
+        }
+        void consumeExpandedPath(const PATH &path) override
+        {
+            output << functionName << ",expanded,";
+            writeBlocks(path);
+        }
+        void approximateFunction(StringRef budgets) override
+        {
+            output << functionName << ",approximated," << budgets << "\n";
+        }
+    };
+
+    /**
+     * Keeps nothing but the number of paths, and reports it at the end of each function unless
+     * report is false.
+     */
+    class CountingPathSink : public PathSink
+    {
+    private:
+        raw_ostream &out;
+        bool report;
+        string functionName;
+        PATH_COUNT canonicalCount;
+        PATH_COUNT expandedCount;
+
+    public:
+        CountingPathSink(raw_ostream &output, bool reportCounts) : out(output)
+        {
+            report = reportCounts;
+            canonicalCount = 0;
+            expandedCount = 0;
+        }
+
+        void beginFunction(const Function &function, const CompactCFG &cfg) override
+        {
+            functionName = function.getName().str();
+            canonicalCount = 0;
+            expandedCount = 0;
+        }
+        void consumeCanonicalPath(PATH_ID id, const PATH &path) override
+        {
+            canonicalCount++;
+        }
+        void consumeExpandedPath(const PATH &path) override
+        {
+            expandedCount++;
+        }
+        void endFunction() override
+        {
+            if (!report)
+            {
+                return;
+            }
+            out << "Function " << functionName << " emitted " << canonicalCount << " canonical paths and "
+                   << expandedCount << " expanded paths.\n";
+        }
+    };
+
+    // The most distinct expanded paths a DeduplicatingPathSink remembers per function, 16 bytes each.
+    static const unsigned MAX_DEDUP_FINGERPRINTS = 1u << 20;
+
+    /**
+     * Forwards only the first occurrence of every expanded path to another sink.
+     * Only a 127-bit fingerprint of every distinct path is kept, made of two independent 64-bit
+     * hashes. Two distinct paths are mistaken for each other only if both hashes collide, which
+     * is negligible at this size. Once MAX_DEDUP_FINGERPRINTS paths are remembered, the rest of the
+     * function is forwarded as is, so the memory used is bounded. The number of dropped paths, and
+     * whether deduplication stopped early, is reported unless report is false.
+     */
+    class DeduplicatingPathSink : public PathSink
+    {
+    private:
+        typedef pair<uint64_t, uint64_t> FINGERPRINT;
+
+        raw_ostream &out;
+        PathSink &next;
+        bool report;
+        DenseSet<FINGERPRINT> seenPaths;
+        bool full;
+        string functionName;
+        unsigned long long duplicates;
+
+        // Remembers path unless it was seen before. Once full, every path counts as new.
+        bool insert(const PATH &path)
+        {
+            if (full)
+            {
+                return true;
+            }
+            StringRef bytes((const char *)path.data(), path.size() * sizeof(BLOCK_ID));
+            // The top bit is cleared so that no path hits the empty and tombstone keys of DenseSet.
+            FINGERPRINT fingerprint((uint64_t)hash_combine_range(path.begin(), path.end()) >> 1, xxHash64(bytes));
+            if (!seenPaths.insert(fingerprint).second)
+            {
+                return false;
+            }
+            full = seenPaths.size() >= MAX_DEDUP_FINGERPRINTS;
+            return true;
+        }
+
+    public:
+        DeduplicatingPathSink(raw_ostream &output, PathSink &nextSink, bool reportDuplicates) : out(output), next(nextSink)
+        {
+            report = reportDuplicates;
+            full = false;
+            duplicates = 0;
+        }
+
+        void beginFunction(const Function &function, const CompactCFG &cfg) override
+        {
+            seenPaths.clear();
+            full = false;
+            functionName = function.getName().str();
+            duplicates = 0;
+            next.beginFunction(function, cfg);
+        }
+        void consumeCanonicalPath(PATH_ID id, const PATH &path) override
+        {
+            next.consumeCanonicalPath(id, path);
+        }
+        void consumeExpandedPath(const PATH &path) override
+        {
+            if (!insert(path))
+            {
+                duplicates++;
+                return;
+            }
+            next.consumeExpandedPath(path);
+        }
+        void approximateFunction(StringRef budgets) override
+        {
+            next.approximateFunction(budgets);
+        }
+        void endFunction() override
+        {
+            if (report && duplicates != 0)
+            {
+                out << "Dropped " << duplicates << " duplicate expanded paths in " << functionName << ".\n";
+            }
+            if (report && full)
+            {
+                out << "Stopped deduplicating the expanded paths of " << functionName << " after "
+                    << MAX_DEDUP_FINGERPRINTS << " distinct paths.\n";
+            }
+            next.endFunction();
+        }
+    };
+}
+
+#endif
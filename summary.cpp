@@ -0,0 +1,360 @@
+#ifndef RPE_SUMMARY_CPP
+#define RPE_SUMMARY_CPP
+
+#include "catalog.cpp"
+
+// LLVM dependencies
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/SCCIterator.h"
+#include "llvm/Analysis/CallGraph.h"
+#include "llvm/IR/ModuleSlotTracker.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/StringSaver.h"
+
+#include <memory>
+#include <tuple>
+
+using namespace llvm;
+using namespace std;
+
+// Rounds a recursive SCC is summarized for before its summaries are taken as they are.
+static const unsigned MAX_SUMMARY_ROUNDS = 8;
+
+namespace
+{
+    // Where the object of a summarized effect comes from, seen from a call site.
+    enum SummaryObjectKind
+    {
+        ArgumentObject, // An argument of the call
+        ReturnedObject, // The value the call returns
+        LocalObject     // Nothing the caller can see, so it is named after the callee's own value
+    };
+
+    /**
+     * A provenance node a function adds whenever it is called.
+     */
+    struct ProvenanceEffect
+    {
+        StringRef action;
+        StringRef artifact;
+        SummaryObjectKind kind;
+        unsigned argument; // Of ArgumentObject effects
+        StringRef localId; // Of LocalObject effects
+
+        bool operator==(const ProvenanceEffect &other) const
+        {
+            return action == other.action && artifact == other.artifact && kind == other.kind && argument == other.argument && localId == other.localId;
+        }
+    };
+
+    /**
+     * What a function does to files, seen from its callers: the effects of its relevant calls
+     * and of the summaries of its callees, in the order its blocks first perform them, and the
+     * argument it returns. Summaries are path-insensitive, so an effect on any path of the
+     * function is an effect of every call.
+     */
+    struct ProvenanceSummary
+    {
+        vector<ProvenanceEffect> effects;
+        int returnedArgument; // -1 when the function returns none of its arguments
+
+        ProvenanceSummary()
+        {
+            returnedArgument = -1;
+        }
+        bool operator==(const ProvenanceSummary &other) const
+        {
+            return returnedArgument == other.returnedArgument && effects == other.effects;
+        }
+    };
+
+    /**
+     * Summaries of every function of a module, computed once bottom-up over the call graph, so
+     * a function is summarized after everything it calls and a call site applies the summary
+     * of its callee instead of walking the callee again. Functions of one recursive SCC are
+     * summarized again until their summaries stop changing, at most MAX_SUMMARY_ROUNDS times.
+     * The summaries are only read once built, so they can be shared by every thread.
+     */
+    class ProvenanceSummaries
+    {
+    private:
+        BumpPtrAllocator allocator;
+        UniqueStringSaver strings;
+        DenseMap<const Function *, ProvenanceSummary> summaries; // Only functions with effects or a returned argument
+
+        /**
+         * Values of one function connected by stores, loads and truncations, the same edges
+         * the provenance of a path unifies objects along, and by calls that return an argument.
+         * Like AliasClasses, only values that can stand for one object are connected, and the
+         * smaller class joins the larger one.
+         */
+        class ValueClasses
+        {
+        private:
+            DenseMap<const Value *, unsigned> ids;
+            vector<unsigned> parents;
+            vector<unsigned> sizes;
+
+        public:
+            unsigned find(const Value *value)
+            {
+                auto inserted = ids.insert(make_pair(value, (unsigned)parents.size()));
+                if (inserted.second)
+                {
+                    parents.push_back(parents.size());
+                    sizes.push_back(1);
+                }
+                unsigned node = inserted.first->second;
+                while (parents[node] != node)
+                {
+                    parents[node] = parents[parents[node]]; // Path halving
+                    node = parents[node];
+                }
+                return node;
+            }
+            void unite(const Value *first, const Value *second)
+            {
+                if (!isObjectValue(first) || !isObjectValue(second))
+                {
+                    return;
+                }
+                unsigned firstRoot = find(first);
+                unsigned secondRoot = find(second);
+                if (firstRoot == secondRoot)
+                {
+                    return;
+                }
+                if (sizes[firstRoot] < sizes[secondRoot])
+                {
+                    swap(firstRoot, secondRoot);
+                }
+                parents[secondRoot] = firstRoot;
+                sizes[firstRoot] += sizes[secondRoot];
+            }
+        };
+
+        const ProvenanceSummary *findSummary(const Function *function) const
+        {
+            auto found = summaries.find(function);
+            return found == summaries.end() ? nullptr : &found->second;
+        }
+
+        // Summary of function given the summaries of its callees so far.
+        ProvenanceSummary summarize(const Function &function, const RelevantFunctions &relevant)
+        {
+            ValueClasses classes;
+            for (const BasicBlock &block : function)
+            {
+                for (const Instruction &inst : block)
+                {
+                    if (const StoreInst *store = dyn_cast<StoreInst>(&inst))
+                    {
+                        classes.unite(store->getPointerOperand(), store->getValueOperand());
+                    }
+                    else if (const LoadInst *load = dyn_cast<LoadInst>(&inst))
+                    {
+                        classes.unite(load->getPointerOperand(), load);
+                    }
+                    else if (isa<TruncInst>(inst))
+                    {
+                        classes.unite(inst.getOperand(0), &inst);
+                    }
+                    else if (const CallBase *call = dyn_cast<CallBase>(&inst))
+                    {
+                        const ProvenanceSummary *calleeSummary = findSummary(call->getCalledFunction());
+                        if (calleeSummary && calleeSummary->returnedArgument >= 0 && (unsigned)calleeSummary->returnedArgument < call->arg_size())
+                        {
+                            classes.unite(call->getArgOperand(calleeSummary->returnedArgument), call);
+                        }
+                    }
+                }
+            }
+
+            vector<unsigned> argumentClasses;
+            for (const Argument &argument : function.args())
+            {
+                argumentClasses.push_back(classes.find(&argument));
+            }
+            DenseSet<unsigned> returnedClasses;
+            for (const BasicBlock &block : function)
+            {
+                if (const ReturnInst *ret = dyn_cast<ReturnInst>(block.getTerminator()))
+                {
+                    if (ret->getReturnValue())
+                    {
+                        returnedClasses.insert(classes.find(ret->getReturnValue()));
+                    }
+                }
+            }
+
+            ProvenanceSummary summary;
+            for (unsigned i = 0; i < argumentClasses.size() && summary.returnedArgument < 0; i++)
+            {
+                if (returnedClasses.count(argumentClasses[i]))
+                {
+                    summary.returnedArgument = i;
+                }
+            }
+
+            unique_ptr<ModuleSlotTracker> slots; // Only needed to name local objects
+            auto addEffect = [&](StringRef action, StringRef artifact, const Value *object)
+            {
+                ProvenanceEffect effect = {action, artifact, LocalObject, 0, StringRef()};
+                unsigned objectClass = classes.find(object);
+                auto argument = find(argumentClasses.begin(), argumentClasses.end(), objectClass);
+                if (argument != argumentClasses.end())
+                {
+                    effect.kind = ArgumentObject;
+                    effect.argument = argument - argumentClasses.begin();
+                }
+                else if (returnedClasses.count(objectClass))
+                {
+                    effect.kind = ReturnedObject;
+                }
+                else
+                {
+                    if (!slots)
+                    {
+                        slots.reset(new ModuleSlotTracker(function.getParent(), false));
+                        slots->incorporateFunction(function);
+                    }
+                    string id;
+                    raw_string_ostream out(id);
+                    out << function.getName() << ":";
+                    object->printAsOperand(out, false, *slots);
+                    effect.localId = strings.save(out.str());
+                }
+                if (find(summary.effects.begin(), summary.effects.end(), effect) == summary.effects.end())
+                {
+                    summary.effects.push_back(effect);
+                }
+            };
+
+            for (const BasicBlock &block : function)
+            {
+                for (const Instruction &inst : block)
+                {
+                    const CallBase *call = dyn_cast<CallBase>(&inst);
+                    if (!call || call->isInlineAsm() || !call->getCalledFunction())
+                    {
+                        continue;
+                    }
+                    const Function *callee = call->getCalledFunction();
+                    if (const RelevantFunctionSpec *spec = relevant.find(callee))
+                    {
+                        if (spec->object == RETURNED_OBJECT || (unsigned)spec->object < call->arg_size())
+                        {
+                            const Value *object = spec->object == RETURNED_OBJECT ? call : call->getArgOperand(spec->object);
+                            addEffect(spec->action, spec->artifact, object);
+                        }
+                        continue;
+                    }
+                    const ProvenanceSummary *calleeSummary = findSummary(callee);
+                    if (!calleeSummary)
+                    {
+                        continue;
+                    }
+                    // Copied, as summarizing a function of a recursive SCC may add to the callee's own summary.
+                    vector<ProvenanceEffect> calleeEffects = calleeSummary->effects;
+                    for (const ProvenanceEffect &effect : calleeEffects)
+                    {
+                        if (effect.kind == ArgumentObject && effect.argument < call->arg_size())
+                        {
+                            addEffect(effect.action, effect.artifact, call->getArgOperand(effect.argument));
+                        }
+                        else if (effect.kind == ReturnedObject)
+                        {
+                            addEffect(effect.action, effect.artifact, call);
+                        }
+                        else if (find(summary.effects.begin(), summary.effects.end(), effect) == summary.effects.end())
+                        {
+                            summary.effects.push_back(effect);
+                        }
+                    }
+                }
+            }
+            return summary;
+        }
+
+        // Stores summary, and returns whether it differs from the one stored before.
+        bool setSummary(const Function *function, ProvenanceSummary &summary)
+        {
+            if (summary.effects.empty() && summary.returnedArgument < 0)
+            {
+                return summaries.erase(function);
+            }
+            ProvenanceSummary &stored = summaries[function];
+            if (stored == summary)
+            {
+                return false;
+            }
+            stored = move(summary);
+            return true;
+        }
+
+    public:
+        ProvenanceSummaries() : strings(allocator) {}
+        ProvenanceSummaries(const ProvenanceSummaries &) = delete;
+        ProvenanceSummaries &operator=(const ProvenanceSummaries &) = delete;
+
+        void build(Module &M, const RelevantFunctions &relevant)
+        {
+            summaries.clear();
+            CallGraph callGraph(M);
+            for (scc_iterator<CallGraph *> scc = scc_begin(&callGraph); !scc.isAtEnd(); ++scc)
+            {
+                vector<const Function *> members;
+                for (CallGraphNode *node : *scc)
+                {
+                    const Function *function = node->getFunction();
+                    if (function && !function->isDeclaration())
+                    {
+                        members.push_back(function);
+                    }
+                }
+                bool changed = true;
+                for (unsigned round = 0; changed && round < (scc.hasCycle() ? MAX_SUMMARY_ROUNDS : 1); round++)
+                {
+                    changed = false;
+                    for (const Function *function : members)
+                    {
+                        ProvenanceSummary summary = summarize(*function, relevant);
+                        changed |= setSummary(function, summary);
+                    }
+                }
+            }
+        }
+
+        // Null for functions that neither touch files nor return an argument.
+        const ProvenanceSummary *getSummary(const Function *function) const
+        {
+            return findSummary(function);
+        }
+
+        // The summaries of every function called by function, for its key in the cache.
+        void printCalleeSummaries(const Function &function, raw_ostream &out) const
+        {
+            for (const BasicBlock &block : function)
+            {
+                for (const Instruction &inst : block)
+                {
+                    const CallBase *call = dyn_cast<CallBase>(&inst);
+                    const ProvenanceSummary *summary = call ? findSummary(call->getCalledFunction()) : nullptr;
+                    if (!summary)
+                    {
+                        continue;
+                    }
+                    out << call->getCalledFunction()->getName() << " returns " << summary->returnedArgument << ":";
+                    for (const ProvenanceEffect &effect : summary->effects)
+                    {
+                        out << " " << effect.action << " " << effect.artifact << " " << effect.kind << " " << effect.argument << " " << effect.localId;
+                    }
+                    out << "\n";
+                }
+            }
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,43 @@
+; Two descriptors that both start out as -1 are still two objects: the constant they share
+; must not put their slots in one alias class.
+; Run by CTest as: opt -load <pass> -load-pass-plugin <pass> -passes=basic-block-extract -disable-output
+;                  -rpe-provenance -rpe-verbose=3 -rpe-path-sink=count %s 2>&1 | FileCheck %s
+
+declare i32 @open(i8*, i32)
+declare i64 @read(i32, i8*, i64)
+declare i32 @close(i32)
+
+@path = constant [2 x i8] c"a\00"
+
+define void @two_files(i8* %buf) {
+entry:
+  %a = alloca i32
+  %b = alloca i32
+  store i32 -1, i32* %a
+  store i32 -1, i32* %b
+  %p = getelementptr [2 x i8], [2 x i8]* @path, i32 0, i32 0
+  %fa = call i32 @open(i8* %p, i32 0)
+  store i32 %fa, i32* %a
+  %fb = call i32 @open(i8* %p, i32 0)
+  store i32 %fb, i32* %b
+  %la = load i32, i32* %a
+  %ra = call i64 @read(i32 %la, i8* %buf, i64 1)
+  %lb = load i32, i32* %b
+  %rb = call i64 @read(i32 %lb, i8* %buf, i64 1)
+  %ca = call i32 @close(i32 %la)
+  %cb = call i32 @close(i32 %lb)
+  ret void
+}
+
+; The edges as found, then once the objects of each alias class are unified.
+; CHECK:      open FILE %fa
+; CHECK-NEXT: open FILE %fb
+; CHECK-NEXT: read FILE %la
+; CHECK-NEXT: read FILE %lb
+; CHECK:      load FILE process_name_start
+; CHECK-NEXT: open FILE %fa
+; CHECK-NEXT: open FILE %fb
+; CHECK-NEXT: read FILE %fa
+; CHECK-NEXT: read FILE %fb
+; CHECK-NEXT: close FILE %fa
+; CHECK-NEXT: close FILE %fb
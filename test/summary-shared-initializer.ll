@@ -0,0 +1,36 @@
+; A callee that resets its argument's slot and its own descriptor's slot to the same -1 must
+; not summarize its own descriptor as the argument: the caller's %x is never opened or closed.
+; Run by CTest as: opt -load <pass> -load-pass-plugin <pass> -passes=basic-block-extract -disable-output
+;                  -rpe-provenance -rpe-verbose=3 -rpe-path-sink=count %s 2>&1 | FileCheck %s
+
+declare i32 @open(i8*, i32)
+declare i32 @close(i32)
+
+@path = constant [2 x i8] c"a\00"
+
+define i32 @reopen(i32 %fd) {
+entry:
+  %slot = alloca i32
+  %local = alloca i32
+  store i32 %fd, i32* %slot
+  store i32 -1, i32* %slot
+  store i32 -1, i32* %local
+  %p = getelementptr [2 x i8], [2 x i8]* @path, i32 0, i32 0
+  %f = call i32 @open(i8* %p, i32 0)
+  store i32 %f, i32* %local
+  %l = load i32, i32* %local
+  %c = call i32 @close(i32 %l)
+  ret i32 0
+}
+
+define void @caller(i32 %x) {
+entry:
+  %r = call i32 @reopen(i32 %x)
+  ret void
+}
+
+; CHECK-LABEL: Current Function: caller
+; CHECK:       load FILE process_name_start
+; CHECK-NEXT:  open FILE reopen:%f
+; CHECK-NEXT:  close FILE reopen:%l
+; CHECK-NOT:   FILE %x
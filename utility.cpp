@@ -1,3 +1,6 @@
+#ifndef RPE_UTILITY_CPP
+#define RPE_UTILITY_CPP
+
 // STL dependencies
 #include <algorithm>
 #include <vector>
@@ -6,9 +9,9 @@
 #include <list>
 #include <utility>
 #include <string>
-#include <regex>
 #include <iterator>
 #include <set>
+#include <cstdio>
 
 // LLVM dependencies
 #include "llvm/Pass.h"
@@ -17,6 +20,7 @@
 #include "llvm/IR/LegacyPassManager.h"
 #include "llvm/Transforms/IPO/PassManagerBuilder.h"
 #include "llvm/IR/Module.h"
+#include "llvm/IR/ModuleSlotTracker.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/CFG.h"
 #include "llvm/Analysis/LoopPass.h"
@@ -42,35 +46,28 @@
 using namespace llvm;
 using namespace std;
 
-typedef list<string> PATH;
-typedef pair<string, string> EDGE;
-typedef vector<string> EDGE_LIST;
-typedef map<string, EDGE_LIST> GRAPH;
+typedef unsigned BLOCK_ID;               // Dense index of a basic block inside its function
+typedef vector<BLOCK_ID> PATH;
+typedef pair<BLOCK_ID, BLOCK_ID> EDGE;
+
+// Pseudo blocks used to delimit an unrolled loop body inside an expanded path.
+static const BLOCK_ID LOOP_START_MARKER = ~0u - 1;
+static const BLOCK_ID LOOP_END_MARKER = ~0u - 2;
 
 namespace
 {
-    static string getSimpleNodeLabel(const BasicBlock &Node)
-    { // Copied from Stack Overflow
+    // Without a tracker, every unnamed block renumbers its whole function, so labelling all
+    // the blocks of a function goes through one tracker that has incorporated it.
+    static string getSimpleNodeLabel(const BasicBlock &Node, ModuleSlotTracker &slots)
+    {
         if (!Node.getName().empty())
-            return Node.getName().str();
-
-        string Str;
-        raw_string_ostream OS(Str);
-
-        Node.printAsOperand(OS, false);
-        return OS.str();
-    }
-
-    static string getSimpleNodeLabel(const BasicBlock *Node)
-    { // Pointer Version
-        if (!Node->getName().empty())
         {
-            return Node->getName().str();
+            return Node.getName().str();
         }
         string Str;
         raw_string_ostream OS(Str);
 
-        Node->printAsOperand(OS, false);
+        Node.printAsOperand(OS, false, slots);
         return OS.str();
     }
 
@@ -82,6 +79,14 @@ namespace
         return OS.str();
     }
 
+    // Whether value can stand for one object: an instruction, an argument or a global variable.
+    // Other constants, such as the -1 or null every descriptor starts out as, are shared by all
+    // their uses, so connecting values through one would merge unrelated objects.
+    static bool isObjectValue(const Value *value)
+    {
+        return isa<Instruction>(value) || isa<Argument>(value) || isa<GlobalVariable>(value);
+    }
+
     static string getTypeFromAddress(Type *type)
     {
         string s;
@@ -89,143 +94,6 @@ namespace
         type->print(OS, false);
         return OS.str();
     }
+}
 
-    static string getInstructionString(Instruction *inst)
-    {
-        string s;
-        raw_string_ostream ss(s);
-        ss << *inst;
-        return ss.str();
-    }
-
-    static void parseInlineAssemblyString(string instructionString, CallInst *call)
-    {
-
-        // errs() << "\n\n";
-        regex pattern("\"([^\"]*)\"");
-        sregex_iterator start(instructionString.begin(), instructionString.end(), pattern);
-        sregex_iterator end;
-        for (sregex_iterator current = start; current != end; ++current)
-        {
-            smatch match = *current;
-            // errs() << match.str() << "\n";
-        }
-        // errs() << "Parsing complete.\n";
-
-        assert(call != NULL);
-        int numOperands = call->getNumOperands();
-        for (int i = 0; i < numOperands - 1; i++)
-        {
-            Value *operand = call->getArgOperand(i);
-            // operand->print(errs(), false);
-            // errs() << "\n";
-        }
-    }
-
-    static string getLeftHandSide(Instruction *inst)
-    {
-        // Untested Functionality
-        string Str;
-        raw_string_ostream OS(Str);
-
-        inst->print(OS, false);
-        string instString = OS.str();
-        size_t foundAt = instString.find('=');
-        string returnValue;
-        if (foundAt != string::npos)
-        {
-            returnValue = instString.substr(0, foundAt);
-            boost::trim(returnValue);
-        }
-        return returnValue;
-    }
-
-    static string getRightHandSide(Instruction *inst)
-    {
-        string Str;
-        raw_string_ostream OS(Str);
-
-        inst->print(OS, false);
-        string instString = OS.str();
-        size_t foundAt = instString.find('=');
-        string returnValue;
-        int len = instString.length();
-        if (foundAt != string::npos)
-        {
-            returnValue = instString.substr(foundAt + 1);
-            boost::trim(returnValue);
-        }
-        return returnValue;
-    }
-
-    static void printEdgeList(vector<pair<string, string>> eList)
-    {
-        for (pair<string, string> edge : eList)
-        {
-            errs() << edge.first << " -> " << edge.second << "\n";
-        }
-    }
-
-    static void printLoopingBlocks(vector<string> loopingBlocks)
-    {
-        errs() << "Looping blocks are: ";
-        for (auto elem : loopingBlocks)
-        {
-            errs() << elem << " ";
-        }
-        errs() << "\n";
-    }
-
-    static void printAdjacencyList(map<string, vector<string>> _adjacencyList)
-    {
-        errs() << "Adjacency List Is:\n";
-        for (auto key : _adjacencyList)
-        {
-            errs() << key.first << " -> ";
-            for (auto elem : key.second)
-            {
-                errs() << elem << ", ";
-            }
-            errs() << "\n";
-        }
-    }
-
-    static void printPath(PATH p)
-    {
-        errs() << "START -> ";
-        for (string s : p)
-        {
-            errs() << s << " ->";
-        }
-        errs() << " END\n";
-    }
-
-    static void printPaths(vector<PATH> _paths)
-    {
-        int pathNum = 0;
-        for (PATH path : _paths)
-        {
-            errs() << "Path Number: " << ++pathNum << "\n";
-            printPath(path);
-        }
-    }
-
-    static void printBackEdges(map<string, EDGE> backEdges)
-    {
-        for (auto &elem : backEdges)
-        {
-
-            errs() << elem.first << " : " << elem.second.first << " -> " << elem.second.second << "\n";
-        }
-    }
-
-    static void printLoopExecutionPaths(map<string, vector<PATH>> pathsInLoops)
-    {
-        for (auto &elem : pathsInLoops)
-        {
-            int numberOfPaths = elem.second.size();
-            errs() << "There are " << numberOfPaths << " in the loop anchored at: " << elem.first << "\n";
-            printPaths(elem.second);
-        }
-    }
-}
\ No newline at end of file
+#endif